@@ -0,0 +1,126 @@
+/****
+ **** arena.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Arenas: bump allocation for the short-lived objects of a batch of sequences (the residue
+ ****  codes and other scratch space of each sequence, the regions found in it, the copied
+ ****  input and the output of a batch), which are all let go at once when the arena is reset
+ ****  for the next batch instead of being freed one by one.
+ ****
+ ****  An arena grows by chaining blocks of at least ARENA_BLOCK_BYTES. When it is reset with
+ ****  more than one block, they are replaced by a single block as large as all that was
+ ****  allocated from them, so after the first batches an arena allocates nothing at all, and
+ ****  its size is what the largest batch needed. The latest allocation can grow in place while
+ ****  its block has room, as a growing list or buffer does, and a block holding only one
+ ****  growing allocation, such as a batch's output, is enlarged with it.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "scan.h"
+
+#define ARENA_ALIGNMENT 16
+
+struct arena_block {
+  struct arena_block *older;
+  size_t size, used;
+  char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+static size_t aligned(size_t size)
+{
+return (size+ARENA_ALIGNMENT-1) & ~(size_t) (ARENA_ALIGNMENT-1);
+} /* end of aligned() */
+
+
+/* adds a block with room for at least size bytes */
+static void add_block(struct arena *a, size_t size)
+{
+struct arena_block *block;
+
+if(size<ARENA_BLOCK_BYTES) { size = ARENA_BLOCK_BYTES; }
+block = malloc(sizeof(struct arena_block)+size);
+block->older = a->block;
+block->size = size;
+block->used = 0;
+a->block = block;
+a->total += size;
+} /* end of add_block() */
+
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+size = aligned(size);
+if(!a->block || a->block->used+size>a->block->size) { add_block(a, size); }
+a->last = a->block->data+a->block->used;
+a->block->used += size;
+return a->last;
+} /* end of arena_alloc() */
+
+
+/* p, of size bytes, enlarged to new_size bytes: in place if it is the latest allocation and
+   there is room, by enlarging its block if it is the only allocation in it, and otherwise
+   copied to a new allocation. p may be NULL */
+void *arena_grow(struct arena *a, void *p, size_t size, size_t new_size)
+{
+struct arena_block *block;
+void *q;
+
+if(p && p==a->last && (char *) p+aligned(new_size)<=a->block->data+a->block->size)
+  {
+  a->block->used = (char *) p-a->block->data+aligned(new_size);
+  return p;
+  }
+if(p && p==a->last && p==a->block->data)
+  {
+  block = realloc(a->block, sizeof(struct arena_block)+aligned(new_size));
+  a->total += aligned(new_size)-block->size;
+  block->size = block->used = aligned(new_size);
+  a->block = block;
+  return a->last = block->data;
+  }
+q = arena_alloc(a, new_size);
+if(p) { memcpy(q, p, size); }
+return q;
+} /* end of arena_grow() */
+
+
+/* lets go of everything allocated from the arena, keeping its memory in one block, as large
+   as all that was allocated */
+void arena_reset(struct arena *a)
+{
+struct arena_block *block;
+size_t used=0;
+
+if(a->block && a->block->older)
+  {
+  for(block=a->block; block; block=block->older) { used += block->used; }
+  arena_free(a);
+  add_block(a, used);
+  }
+if(a->block) { a->block->used = 0; }
+a->last = NULL;
+} /* end of arena_reset() */
+
+
+void arena_free(struct arena *a)
+{
+struct arena_block *block, *older;
+
+for(block=a->block; block; block=older)
+   {
+   older = block->older;
+   free(block);
+   }
+memset(a, 0, sizeof(*a));
+} /* end of arena_free() */
+
+/******** END OF CODE FILE ********/
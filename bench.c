@@ -0,0 +1,229 @@
+/****
+ **** bench.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Benchmarks of libparameters and the programs, run by 'make bench', which writes the
+ ****  results as JSON so that they can be kept and compared between versions:
+ ****
+ ****    {"benchmarks": [{"name": ..., "unit": ..., "value": ..., "operations": ...}, ...], ...}
+ ****
+ ****  Each benchmark is repeated until it has run for at least MIN_SECONDS. They time single
+ ****  queries, the whole grid of parameters, formatted output, and, given a FASTA file (such
+ ****  as one from makeproteome), the SEG and fLPS scanners on their own and the programs'
+ ****  scans from end to end.
+ ****
+ ****    benchmark [proteome.fasta]
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "parameters.h"
+#include "scan.h"
+
+#define MIN_SECONDS 0.25
+
+static int n_results;
+
+static double now(void)
+{
+struct timespec t;
+
+clock_gettime(CLOCK_MONOTONIC, &t);
+return t.tv_sec + t.tv_nsec*1e-9;
+} /* end of now() */
+
+
+static void report(const char *name, const char *unit, double value, long operations)
+{
+printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.6g, \"operations\": %ld}",
+       n_results++ ? "," : "", name, unit, value, operations);
+fflush(stdout);
+} /* end of report() */
+
+
+/*  *  *  * PARAMETER GENERATION *  *  *  */
+
+static volatile double sink;  /* keeps the results from being optimized away */
+
+/* one query at a time, over every tool, focus, fitted coverage and target length in turn */
+static void bench_queries(const char *name, int interpolated, int use_tables)
+{
+struct parameter_set ps;
+double start=now(), elapsed;
+long n=0;
+int tool, focus, i, target_length, coverage;
+
+do {
+   for(tool=SEG; tool<=FLPS; tool++)
+      for(focus=DIVERSE; focus<=NARROW; focus++)
+         for(i=0; i<NUMBER_OF_COVERAGES; i++)
+            for(target_length=MIN_TARGET_LENGTH; target_length<=MAX_TARGET_LENGTH; target_length++, n++)
+               {
+               coverage = interpolated ? coverage_levels[i]+1 : coverage_levels[i];
+               ps = use_tables ? lookup_parameters(tool, focus, target_length, coverage)
+                               : evaluate_model(&builtin_models, tool, focus, target_length, coverage);
+               sink += ps.K2 + ps.threshold;
+               }
+   } while((elapsed = now()-start)<MIN_SECONDS);
+report(name, "ns/query", elapsed*1e9/n, n);
+} /* end of bench_queries() */
+
+
+/* the whole grid with evaluate_grid(), at every hundredth of a target length from 5 to 300 */
+static void bench_grid(enum grid_isa isa)
+{
+struct parameter_set *sets;
+double *lengths, start, elapsed;
+char name[64];
+long n=0;
+int tool, focus, i, n_lengths=29501;
+
+lengths = malloc(n_lengths*sizeof(double));
+sets = malloc(n_lengths*sizeof(struct parameter_set));
+for(i=0; i<n_lengths; i++) { lengths[i] = MIN_TARGET_LENGTH+i/100.0; }
+start=now();
+do {
+   for(tool=SEG; tool<=FLPS; tool++)
+      for(focus=DIVERSE; focus<=NARROW; focus++)
+         for(i=0; i<NUMBER_OF_COVERAGES; i++, n+=n_lengths)
+            { evaluate_grid_isa(isa, &builtin_models, tool, focus, coverage_levels[i], lengths, n_lengths, sets); }
+   } while((elapsed = now()-start)<MIN_SECONDS);
+sprintf(name, "evaluate_grid_%s", grid_isa_name[isa]);
+report(name, "ns/point", elapsed*1e9/n, n);
+free(lengths);
+free(sets);
+} /* end of bench_grid() */
+
+
+/* formatted output of the whole grid to a memory stream */
+static void bench_output(enum output_format format, const char *name)
+{
+struct parameter_set ps;
+char *buffer=NULL;
+size_t size=0;
+FILE *out;
+double start=now(), elapsed;
+long n=0;
+int tool, focus, i, target_length;
+
+do {
+   out = open_memstream(&buffer, &size);
+   for(tool=SEG; tool<=FLPS; tool++)
+      for(focus=DIVERSE; focus<=NARROW; focus++)
+         for(target_length=MIN_TARGET_LENGTH; target_length<=MAX_TARGET_LENGTH; target_length++)
+            for(i=0; i<NUMBER_OF_COVERAGES; i++, n++)
+               {
+               ps = lookup_parameters(tool, focus, target_length, coverage_levels[i]);
+               write_parameters(out, &ps, format);
+               }
+   fclose(out);
+   } while((elapsed = now()-start)<MIN_SECONDS);
+free(buffer);
+report(name, "ns/record", elapsed*1e9/n, n);
+} /* end of bench_output() */
+
+
+/*  *  *  * SCANNING *  *  *  */
+
+/* one pass of a scanner over the file, with the parameters for target length 15 at every
+   coverage level in one scan; reports the rate in residues per second */
+static void bench_scanner(const char *filename, enum parameter_tool tool)
+{
+struct fasta_reader *fr;
+struct fasta_record record;
+struct seg_scanner *seg[NUMBER_OF_COVERAGES];
+struct flps_scanner *flps=NULL;
+struct flps_set sets[NUMBER_OF_COVERAGES];
+struct region_list regions[NUMBER_OF_COVERAGES];
+struct parameter_set ps[NUMBER_OF_COVERAGES];
+unsigned char *codes=NULL;
+double start, elapsed;
+long residues=0;
+int i, n=0, codes_size=0;
+
+for(i=0; i<NUMBER_OF_COVERAGES; i++)
+   {
+   ps[n] = lookup_parameters(tool, DIVERSE, 15, coverage_levels[i]);
+   if(ps[n].not_valid) { continue; }
+   if(tool==SEG) { seg[n] = seg_create(ps[n].L, ps[n].K1, ps[n].K2); }
+   else { sets[n].small_m = ps[n].small_m; sets[n].big_m = ps[n].big_m; sets[n].threshold = ps[n].threshold; }
+   n++;
+   }
+if(tool==FLPS) { flps = flps_create(n, sets, background_frequencies); }
+memset(regions, 0, sizeof(regions));
+
+if(!(fr = fasta_open(filename, 1))) { fprintf(stderr, "bench: cannot open %s\n", filename); exit(1); }
+start=now();
+while(fasta_next(fr, &record))
+     {
+     if(record.length>codes_size) { codes_size = record.length; codes = realloc(codes, codes_size); }
+     encode_sequence(record.sequence, record.length, codes);
+     if(tool==SEG) { for(i=0; i<n; i++) { seg_scan(seg[i], codes, record.length, &regions[i]); } }
+     else { flps_scan(flps, codes, record.length, regions); }
+     residues += record.length;
+     fasta_release(fr, record.header);
+     }
+elapsed = now()-start;
+fasta_close(fr);
+
+report(tool==SEG ? "seg_scan" : "flps_scan", "residues/s", residues/elapsed, residues);
+if(tool==SEG) { for(i=0; i<n; i++) { seg_free(seg[i]); } }
+else { flps_free(flps); }
+for(i=0; i<n; i++) { free(regions[i].regions); }
+free(codes);
+} /* end of bench_scanner() */
+
+
+/* a program's scan of the whole file, from start to end */
+static void bench_program(const char *name, const char *command, const char *filename)
+{
+char line[1024];
+double start, elapsed;
+struct stat st;
+
+snprintf(line, sizeof(line), "%s %s > /dev/null", command, filename);
+start=now();
+if(system(line)) { fprintf(stderr, "bench: '%s' failed\n", line); return; }
+elapsed = now()-start;
+stat(filename, &st);
+report(name, "MB/s", st.st_size/elapsed/1e6, 1);
+} /* end of bench_program() */
+
+
+int main(int argc, char **argv)
+{
+int isa;
+
+printf("{\n  \"grid_isa\": \"%s\",\n  \"benchmarks\": [", grid_isa_name[best_grid_isa()]);
+
+bench_queries("lookup_parameters", 0, 1);
+bench_queries("evaluate_model", 0, 0);
+bench_queries("evaluate_model_interpolated", 1, 0);
+for(isa=GRID_SCALAR; isa<=GRID_AVX512; isa++) { if(grid_isa_supported(isa)) { bench_grid(isa); } }
+bench_output(TSV_FORMAT, "output_tsv");
+bench_output(JSON_FORMAT, "output_json");
+bench_output(BINARY_FORMAT, "output_binary");
+
+if(argc>1)
+  {
+  bench_scanner(argv[1], SEG);
+  bench_scanner(argv[1], FLPS);
+  bench_program("SEGparameters_scan", "./SEGparameters -l 15 -a -s", argv[1]);
+  bench_program("fLPSparameters_scan", "./fLPSparameters -l 15 -a -s", argv[1]);
+  }
+
+printf("\n  ]\n}\n");
+exit(0);
+} /* end of main() */
+
+/******** END OF CODE FILE ********/
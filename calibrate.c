@@ -0,0 +1,645 @@
+/****
+ **** calibrate.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Calibration of the parameter models against a proteome. The tool's scanner is run over
+ ****  the proteome with a grid of parameter sets around each model: window sizes (SEG L or
+ ****  fLPS M) crossed with cutoffs (SEG K2 or fLPS t), with the companion parameter (K1 or m)
+ ****  following the model. For each grid point the coverage (the proportion of sequences with
+ ****  at least one region) and the lengths of the regions found are recorded.
+ ****
+ ****  For each window size, the cutoff that gives the model's coverage level is found by
+ ****  interpolating between the cutoffs either side of it, along with the mean region length
+ ****  there, which is taken as the target length that the window and cutoff are suited to (for
+ ****  SEG NARROW, the target length is L itself). The model's curves are then refitted to these
+ ****  points in their original forms, by least squares: the window as a power law of the
+ ****  target length, and the cutoff as a log (SEG) or linear (fLPS) function of it. The fitted
+ ****  curves have no breakpoints, and the range of target lengths found becomes the model's
+ ****  bounds.
+ ****
+ ****  The spread of the region lengths is recorded too, so that the mean and the standard
+ ****  deviation of the lengths are fitted as power laws of the target length, in the same way,
+ ****  for the models' predictions of the length distribution (lengths.c). The log-normal
+ ****  histogram those predict is compared with the one found, and the mean difference between
+ ****  them (half the sum of the differences in each bin, 0 to 1) reported.
+ ****
+ ****  The proteome is read once. Grid points shared by several models are scanned once; SEG
+ ****  points with the same L share their window complexities, and fLPS points with the same
+ ****  window sizes are scanned in one pass. Sequences are shared out between threads by
+ ****  scan_fasta(), with per-thread counts that are added up at the end.
+ ****
+ ****  With a grid file (-I), the counts of every grid point scanned are kept from one run to
+ ****  the next, tied to the FASTA file's size and modification time as the summary index is
+ ****  (summary.c). A later calibration of the same proteome then scans for only the grid points
+ ****  it has no counts of, and does not read the proteome at all if it has them all: a rerun,
+ ****  or one with models whose grids overlap. The file is a 64-byte header,
+ ****     0  char[8]  "PGRIDCNT"
+ ****     8  uint32   version (GRID_VERSION), byte order mark 0x01020304, tool, record size
+ ****    24  uint64   number of grid points, number of sequences, size of the FASTA file, and
+ ****                 its modification time (seconds and nanoseconds)
+ ****  then a struct grid_record per grid point, in the order of compare_points(). A file of
+ ****  another version, tool or kind of machine, or of the FASTA file as it was, is replaced.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scan.h"
+
+/* the window sizes and cutoffs that make up the grid, each narrowed to the range around a model */
+static const int grid_windows[] = {
+  5, 6, 7, 8, 9, 10, 11, 12, 14, 16, 18, 20, 23, 26, 29, 33, 37, 42, 47, 53, 60, 67, 75, 84, 94,
+  105, 118, 132, 148, 166, 186, 208, 233, 261, 292 };
+#define GRID_WINDOWS ((int) (sizeof(grid_windows)/sizeof(int)))
+#define SEG_CUTOFF_STEP 0.1      /* K2 from 0.5 to 4.5 */
+#define FLPS_CUTOFF_STEP 1.0     /* log10 t from -80 to -1 */
+#define MIN_FIT_POINTS 3
+#define GRID_MAGIC "PGRIDCNT"
+#define GRID_VERSION 1
+#define GRID_BYTE_ORDER 0x01020304u
+
+struct grid_point {
+  double window, companion, cutoff;  /* L, K1, K2 or M, m, log10 t */
+};
+
+struct point_counts {
+  long covered, regions;
+  double sum_length, sum_length2;
+  long histogram[LENGTH_BINS];  /* of region lengths, in the bins of length_bin() */
+};
+
+struct grid_header {
+  char magic[8];
+  uint32_t version, byte_order, tool, record_size;
+  uint64_t n_points, n_sequences, fasta_size;
+  int64_t fasta_seconds, fasta_nanoseconds;
+};
+
+struct grid_record {
+  struct grid_point point;
+  struct point_counts counts;
+};
+
+struct calibration {
+  enum parameter_tool tool;
+  struct grid_point *points;
+  int n_points;
+  int *model_points[2][NUMBER_OF_COVERAGES];        /* [focus][coverage]: [window][cutoff] point indices */
+  int n_windows[2][NUMBER_OF_COVERAGES], n_cutoffs[2][NUMBER_OF_COVERAGES];
+  int first_window[2][NUMBER_OF_COVERAGES];         /* index into grid_windows[] */
+  double first_cutoff[2][NUMBER_OF_COVERAGES];
+  int *scan_points, n_scan;                          /* the points to scan for: those without counts */
+  int n_groups;
+  int *group_start;                                 /* the first of scan_points of each group */
+  struct flps_scanner **flps;                       /* per group, for the first thread */
+  struct grid_record *kept;                         /* read from the grid file */
+  long n_kept;
+  int n_threads;
+  struct calibration_state *states;
+};
+
+struct calibration_state {  /* one per thread */
+  struct seg_scanner **seg;
+  struct flps_scanner **flps;
+  struct region_list regions[MAX_PARAMETER_SETS];
+  long sequences;
+  struct point_counts *counts;
+};
+
+
+/* the target length whose window is nearest w, by the model */
+static double model_length(const struct parameter_model *model, double w)
+{
+double x, best=1.0, error, best_error=HUGE_VAL;
+
+for(x=1.0; x<=2000.0; x++)
+   {
+   error = fabs(curve_value(&model->window, x, 0.0) - w);
+   if(error<best_error) { best_error=error; best=x; }
+   }
+return best;
+} /* end of model_length() */
+
+
+static int compare_points(const void *a, const void *b)
+{
+const struct grid_point *p=a, *q=b;
+
+if(p->window!=q->window) { return p->window<q->window ? -1 : 1; }
+if(p->companion!=q->companion) { return p->companion<q->companion ? -1 : 1; }
+if(p->cutoff!=q->cutoff) { return p->cutoff<q->cutoff ? -1 : 1; }
+return 0;
+} /* end of compare_points() */
+
+
+static int find_point(const struct calibration *cal, const struct grid_point *point)
+{
+int low=0, high=cal->n_points-1, middle, c;
+
+while(low<=high)
+     {
+     middle = (low+high)/2;
+     if(!(c = compare_points(point, &cal->points[middle]))) { return middle; }
+     if(c<0) { high=middle-1; } else { low=middle+1; }
+     }
+return -1;
+} /* end of find_point() */
+
+
+/* the grid point for window w and cutoff k of a model, with the companion that the model gives
+   at x, the target length for w */
+static struct grid_point model_point(enum parameter_tool tool, const struct parameter_model *model, double x,
+                                     double w, double k)
+{
+struct grid_point point = {0};
+
+point.window = w;
+point.cutoff = k;
+if(tool==SEG) { point.companion = round(curve_value(&model->companion, x, k)*100.0)/100.0; }
+else {
+     point.companion = round(curve_value(&model->companion, x, w));
+     if(point.companion<1.0) { point.companion=1.0; }
+     if(point.companion>w) { point.companion=w; }  /* a refitted window can fall below the old m */
+     }
+return point;
+} /* end of model_point() */
+
+
+/* lays out the grid around each of the tool's models, and merges the points they share */
+static void build_grid(struct calibration *cal, const struct parameter_models *models)
+{
+const struct parameter_model *model;
+struct grid_point *candidates, point;
+double w_low, w_high, k_low, k_high, x, k, step, k_min, k_max;
+int focus, i, j, n=0, size=0, w, c;
+
+step = cal->tool==SEG ? SEG_CUTOFF_STEP : FLPS_CUTOFF_STEP;
+k_min = cal->tool==SEG ? 0.5 : -80.0;
+k_max = cal->tool==SEG ? 4.5 : -1.0;
+candidates = NULL;
+
+for(focus=DIVERSE; focus<=NARROW; focus++)
+   for(i=0; i<NUMBER_OF_COVERAGES; i++)
+      {
+      model = &models->model[cal->tool][focus][i];
+      w_low=k_low=HUGE_VAL; w_high=k_high=-HUGE_VAL;
+      for(x=model->lower_bound; x<=model->upper_bound; x++)
+         {
+         w = round(curve_value(&model->window, x, 0.0));
+         k = curve_value(&model->cutoff, x, 0.0);
+         if(w<w_low) { w_low=w; } if(w>w_high) { w_high=w; }
+         if(k<k_low) { k_low=k; } if(k>k_high) { k_high=k; }
+         }
+      w_low*=0.7; w_high*=1.4;
+      k_low -= cal->tool==SEG ? 0.5 : 5.0;
+      k_high += cal->tool==SEG ? 0.5 : 2.0;
+      if(k_low<k_min) { k_low=k_min; }
+      if(k_high>k_max) { k_high=k_max; }
+
+      for(j=0; j<GRID_WINDOWS && grid_windows[j]<w_low; j++) { ; }
+      cal->first_window[focus][i] = j;
+      for(cal->n_windows[focus][i]=0; j<GRID_WINDOWS && grid_windows[j]<=w_high; j++) { cal->n_windows[focus][i]++; }
+      cal->first_cutoff[focus][i] = k_min + ceil((k_low-k_min)/step)*step;
+      cal->n_cutoffs[focus][i] = floor((k_high-cal->first_cutoff[focus][i])/step + 1e-9) + 1;
+
+      for(w=0; w<cal->n_windows[focus][i]; w++)
+         for(c=0, x=model_length(model, grid_windows[cal->first_window[focus][i]+w]); c<cal->n_cutoffs[focus][i]; c++)
+            {
+            if(n==size) { size = size ? 2*size : 1024; candidates = realloc(candidates, size*sizeof(struct grid_point)); }
+            k = round((cal->first_cutoff[focus][i] + c*step)*100.0)/100.0;
+            candidates[n++] = model_point(cal->tool, model, x, grid_windows[cal->first_window[focus][i]+w], k);
+            }
+      }
+
+qsort(candidates, n, sizeof(struct grid_point), compare_points);
+for(i=j=0; i<n; i++) { if(!j || compare_points(&candidates[i], &candidates[j-1])) { candidates[j++] = candidates[i]; } }
+cal->points = candidates;
+cal->n_points = j;
+
+for(focus=DIVERSE; focus<=NARROW; focus++)
+   for(i=0; i<NUMBER_OF_COVERAGES; i++)
+      {
+      model = &models->model[cal->tool][focus][i];
+      cal->model_points[focus][i] = malloc(cal->n_windows[focus][i]*cal->n_cutoffs[focus][i]*sizeof(int));
+      for(w=0; w<cal->n_windows[focus][i]; w++)
+         for(c=0, x=model_length(model, grid_windows[cal->first_window[focus][i]+w]); c<cal->n_cutoffs[focus][i]; c++)
+            {
+            k = round((cal->first_cutoff[focus][i] + c*step)*100.0)/100.0;
+            point = model_point(cal->tool, model, x, grid_windows[cal->first_window[focus][i]+w], k);
+            cal->model_points[focus][i][w*cal->n_cutoffs[focus][i]+c] = find_point(cal, &point);
+            }
+      }
+} /* end of build_grid() */
+
+
+/* groups the points to scan for by scanner: SEG points by L, fLPS points by m and M, at most
+   MAX_PARAMETER_SETS to a group; the points are sorted, so each group's are consecutive */
+static void group_points(struct calibration *cal)
+{
+struct grid_point *p, *q;
+struct flps_set sets[MAX_PARAMETER_SETS];
+int i, n=0;
+
+cal->group_start = malloc((cal->n_scan+1)*sizeof(int));
+cal->n_groups = 0;
+for(i=0; i<cal->n_scan; i++)
+   {
+   p = &cal->points[cal->scan_points[i]];
+   q = i ? &cal->points[cal->scan_points[i-1]] : NULL;
+   if(!q || p->window!=q->window || (cal->tool==FLPS && (p->companion!=q->companion || n==MAX_PARAMETER_SETS)))
+     { cal->group_start[cal->n_groups++] = i; n=0; }
+   n++;
+   }
+cal->group_start[cal->n_groups] = cal->n_scan;
+
+if(cal->tool==SEG) { return; }
+cal->flps = malloc(cal->n_groups*sizeof(struct flps_scanner *));
+for(i=0; i<cal->n_groups; i++)
+   {
+   for(n=0; cal->group_start[i]+n<cal->group_start[i+1]; n++)
+      {
+      p = &cal->points[cal->scan_points[cal->group_start[i]+n]];
+      sets[n].big_m = p->window;
+      sets[n].small_m = p->companion;
+      sets[n].threshold = p->cutoff;
+      }
+   cal->flps[i] = flps_create(n, sets, background_frequencies);
+   }
+} /* end of group_points() */
+
+
+static void count_regions(struct point_counts *counts, const struct region_list *regions)
+{
+int i, length;
+
+if(!regions->n) { return; }
+counts->covered++;
+counts->regions += regions->n;
+for(i=0; i<regions->n; i++)
+   {
+   length = regions->regions[i].end - regions->regions[i].start;
+   counts->sum_length += length;
+   counts->sum_length2 += (double) length*length;
+   counts->histogram[length_bin(length)]++;
+   }
+} /* end of count_regions() */
+
+
+/* scans one sequence with every grid point to scan for */
+static void calibrate_record(void *context, int thread, const struct fasta_record *record, struct arena *arena,
+                             FILE *out)
+{
+struct calibration *cal=context;
+struct calibration_state *state=&cal->states[thread];
+struct grid_point *p;
+unsigned char *codes=arena_alloc(arena, record->length);
+int g, i, first;
+
+(void) out;  /* the counts are kept per thread; nothing is written */
+encode_sequence(record->sequence, record->length, codes);
+for(i=0; i<MAX_PARAMETER_SETS; i++) { start_regions(&state->regions[i], arena); }
+state->sequences++;
+
+for(g=0; g<cal->n_groups; g++)
+   {
+   first = cal->group_start[g];
+   if(cal->tool==SEG)
+     {
+     if(record->length<cal->points[cal->scan_points[first]].window) { continue; }
+     seg_complexity(state->seg[g], codes, record->length);
+     for(i=first; i<cal->group_start[g+1]; i++)
+        {
+        p = &cal->points[cal->scan_points[i]];
+        seg_regions(state->seg[g], record->length, p->companion, p->cutoff, &state->regions[0]);
+        count_regions(&state->counts[cal->scan_points[i]], &state->regions[0]);
+        }
+     }
+   else {
+        if(record->length<cal->points[cal->scan_points[first]].companion) { continue; }
+        flps_scan(state->flps[g], codes, record->length, state->regions);
+        for(i=first; i<cal->group_start[g+1]; i++)
+           { count_regions(&state->counts[cal->scan_points[i]], &state->regions[i-first]); }
+        }
+   } /* end of for each group */
+} /* end of calibrate_record() */
+
+
+/* least-squares fit of y = a*x + b; returns the coefficient of determination, or -1 if it cannot be fitted */
+static double fit_line(const double *x, const double *y, int n, double *a, double *b)
+{
+double mx=0, my=0, sxx=0, sxy=0, syy=0;
+int i;
+
+if(n<MIN_FIT_POINTS) { return -1.0; }
+for(i=0; i<n; i++) { mx+=x[i]; my+=y[i]; }
+mx/=n; my/=n;
+for(i=0; i<n; i++) { sxx+=(x[i]-mx)*(x[i]-mx); sxy+=(x[i]-mx)*(y[i]-my); syy+=(y[i]-my)*(y[i]-my); }
+if(sxx<=0.0) { return -1.0; }
+*a = sxy/sxx;
+*b = my - *a*mx;
+return syy>0.0 ? sxy*sxy/(sxx*syy) : 1.0;
+} /* end of fit_line() */
+
+
+/* refits one model from the counts; returns 0 if there were too few points, leaving the model as it was */
+static int fit_model(struct calibration *cal, const struct point_counts *counts, long sequences,
+                     enum calculation_type focus, int i, struct parameter_model *model, FILE *report)
+{
+int n_windows=cal->n_windows[focus][i], n_cutoffs=cal->n_cutoffs[focus][i];
+int w, c, n=0, m, bin, *index;
+double target=coverage_levels[i]/100.0, coverage, previous, f, length, previous_length, sd, previous_sd;
+double *x, *log_x, *window, *log_window, *cutoff, a, b, r_window=1.0, r_cutoff, x_low=HUGE_VAL, x_high=0.0;
+double *mean_length, *length_sd, *histogram, *log_mean, *log_sd, *length_x, a_sd, b_sd, r_mean, r_sd;
+double predicted[LENGTH_BINS], distance=0.0;
+const struct point_counts *k, *j;
+struct model_curve curve;
+
+x = malloc((10+LENGTH_BINS)*n_windows*sizeof(double));
+log_x=x+n_windows; window=log_x+n_windows; log_window=window+n_windows; cutoff=log_window+n_windows;
+mean_length=cutoff+n_windows; length_sd=mean_length+n_windows; log_mean=length_sd+n_windows;
+log_sd=log_mean+n_windows; length_x=log_sd+n_windows; histogram=length_x+n_windows;
+
+for(w=0; w<n_windows; w++)
+   {
+   index = &cal->model_points[focus][i][w*n_cutoffs];
+   for(c=1; c<n_cutoffs; c++) { if((double) counts[index[c]].covered/sequences>=target) { break; } }
+   if(c==n_cutoffs || (double) counts[index[0]].covered/sequences>=target) { continue; }
+
+   /* interpolate between the cutoffs either side of the coverage level */
+   j = &counts[index[c-1]];
+   k = &counts[index[c]];
+   previous = (double) j->covered/sequences;
+   coverage = (double) k->covered/sequences;
+   f = (target-previous)/(coverage-previous);
+   length = k->sum_length/k->regions;
+   previous_length = j->regions ? j->sum_length/j->regions : length;
+   sd = sqrt(fmax(k->sum_length2/k->regions - length*length, 0.0));
+   previous_sd = j->regions ? sqrt(fmax(j->sum_length2/j->regions - previous_length*previous_length, 0.0)) : sd;
+   mean_length[n] = previous_length + f*(length-previous_length);
+   length_sd[n] = previous_sd + f*(sd-previous_sd);
+   for(bin=0; bin<LENGTH_BINS; bin++)
+      {
+      histogram[n*LENGTH_BINS+bin] = (double) k->histogram[bin]/k->regions;
+      if(j->regions) { histogram[n*LENGTH_BINS+bin] += (1.0-f)*((double) j->histogram[bin]/j->regions - histogram[n*LENGTH_BINS+bin]); }
+      }
+
+   window[n] = cal->points[index[c]].window;
+   cutoff[n] = cal->points[index[c-1]].cutoff + f*(cal->points[index[c]].cutoff - cal->points[index[c-1]].cutoff);
+   x[n] = cal->tool==SEG && focus==NARROW ? window[n] : mean_length[n];
+   if(x[n]<1.0) { continue; }
+   log_x[n] = log(x[n]);
+   log_window[n] = log(window[n]);
+   if(x[n]<x_low) { x_low=x[n]; }
+   if(x[n]>x_high) { x_high=x[n]; }
+   n++;
+   } /* end of for each window size */
+
+fprintf(report, "# %s %s ~%d%%: %d of %d window sizes reach the coverage level", tool_name[cal->tool],
+        focus_name[focus], coverage_levels[i], n, n_windows);
+
+/* the window, unless it is the target length (SEG NARROW) */
+if(!(cal->tool==SEG && focus==NARROW))
+  {
+  if((r_window = fit_line(log_x, log_window, n, &a, &b))<0) { fprintf(report, ", too few to fit\n"); free(x); return 0; }
+  curve.lo = curve.hi = NO_BREAKPOINT;
+  curve.below.form=POWER; curve.below.a=exp(b); curve.below.b=a;
+  memset(&curve.above, 0, sizeof(curve.above));
+  model->window = curve;
+  }
+
+if(cal->tool==SEG) { r_cutoff = fit_line(log_x, cutoff, n, &a, &b); }
+else { r_cutoff = fit_line(x, cutoff, n, &a, &b); }
+if(r_cutoff<0) { fprintf(report, ", too few to fit\n"); free(x); return 0; }
+curve.lo = curve.hi = NO_BREAKPOINT;
+curve.below.form = cal->tool==SEG ? LOG : LINEAR; curve.below.a=a; curve.below.b=b;
+memset(&curve.above, 0, sizeof(curve.above));
+model->cutoff = curve;
+
+model->lower_bound = ceil(x_low)<MIN_TARGET_LENGTH ? MIN_TARGET_LENGTH : ceil(x_low);
+model->upper_bound = floor(x_high)>MAX_TARGET_LENGTH ? MAX_TARGET_LENGTH : floor(x_high);
+fprintf(report, ", target lengths %d-%d, R^2 %.3lf (window) %.3lf (cutoff)",
+        model->lower_bound, model->upper_bound, r_window, r_cutoff);
+
+/* the region lengths, from the window sizes whose regions have some spread */
+for(w=m=0; w<n; w++)
+   {
+   if(mean_length[w]<1.0 || length_sd[w]<=0.0) { continue; }
+   length_x[m] = log_x[w];
+   log_mean[m] = log(mean_length[w]);
+   log_sd[m] = log(length_sd[w]);
+   m++;
+   }
+if((r_mean = fit_line(length_x, log_mean, m, &a, &b))<0 || (r_sd = fit_line(length_x, log_sd, m, &a_sd, &b_sd))<0)
+  { fprintf(report, ", too few to fit the lengths\n"); free(x); return 1; }
+curve.lo = curve.hi = NO_BREAKPOINT;
+curve.below.form=POWER; curve.below.a=exp(b); curve.below.b=a;
+memset(&curve.above, 0, sizeof(curve.above));
+model->length_mean = curve;
+curve.below.a=exp(b_sd); curve.below.b=a_sd;
+model->length_sd = curve;
+
+for(w=0; w<n; w++)
+   {
+   sd = curve_value(&model->length_sd, x[w], 0.0);
+   lognormal_histogram(curve_value(&model->length_mean, x[w], 0.0), sd*sd, predicted);
+   for(bin=0; bin<LENGTH_BINS; bin++) { distance += fabs(predicted[bin]-histogram[w*LENGTH_BINS+bin])/2.0; }
+   }
+fprintf(report, ", R^2 %.3lf (mean length) %.3lf (sd), histogram difference %.3lf\n", r_mean, r_sd, distance/n);
+free(x);
+return 1;
+} /* end of fit_model() */
+
+
+/* the header of a grid file for the tool and the FASTA file as it is now, with no points yet;
+   returns 0 if fasta is not a regular file */
+static int grid_header(enum parameter_tool tool, const char *fasta, struct grid_header *header)
+{
+struct stat st;
+
+if(stat(fasta, &st) || !S_ISREG(st.st_mode)) { return 0; }
+memset(header, 0, sizeof(*header));
+memcpy(header->magic, GRID_MAGIC, 8);
+header->version = GRID_VERSION;
+header->byte_order = GRID_BYTE_ORDER;
+header->tool = tool;
+header->record_size = sizeof(struct grid_record);
+header->fasta_size = st.st_size;
+header->fasta_seconds = st.st_mtim.tv_sec;
+header->fasta_nanoseconds = st.st_mtim.tv_nsec;
+return 1;
+} /* end of grid_header() */
+
+
+/* reads the grid file into cal->kept if its header matches expected, and copies the counts of
+   the grid's points that it has into counts, marking them known; returns the number of
+   sequences they were counted over, or 0 if the file cannot be used */
+static long read_grid_file(struct calibration *cal, const char *filename, const struct grid_header *expected,
+                           struct point_counts *counts, char *known)
+{
+struct grid_header header;
+const struct grid_record *record;
+FILE *in;
+int i;
+
+if(!(in = fopen(filename, "rb"))) { return 0; }
+if(fread(&header, sizeof(header), 1, in)!=1 || memcmp(&header, expected, offsetof(struct grid_header, n_points))
+   || header.fasta_size!=expected->fasta_size || header.fasta_seconds!=expected->fasta_seconds
+   || header.fasta_nanoseconds!=expected->fasta_nanoseconds)
+  { fclose(in); return 0; }
+cal->kept = malloc(header.n_points*sizeof(struct grid_record));
+if(fread(cal->kept, sizeof(struct grid_record), header.n_points, in)!=header.n_points)
+  { fclose(in); free(cal->kept); cal->kept=NULL; return 0; }
+fclose(in);
+cal->n_kept = header.n_points;
+
+/* a grid_record starts with its point, so the records can be searched with compare_points() */
+for(i=0; i<cal->n_points; i++)
+   {
+   record = bsearch(&cal->points[i], cal->kept, cal->n_kept, sizeof(struct grid_record), compare_points);
+   if(record) { counts[i] = record->counts; known[i] = 1; }
+   }
+return header.n_sequences;
+} /* end of read_grid_file() */
+
+
+/* writes the counts of the grid's points, and of the points kept from the grid file that are
+   not in the grid, to the grid file; returns -1 if it cannot be written */
+static int write_grid_file(const struct calibration *cal, const char *filename, struct grid_header *header,
+                           const struct point_counts *counts, long sequences)
+{
+struct grid_record record;
+FILE *out;
+long k=0;
+int i=0, c;
+
+if(!(out = fopen(filename, "wb"))) { return -1; }
+header->n_points = 0;
+header->n_sequences = sequences;
+fwrite(header, sizeof(*header), 1, out);
+while(i<cal->n_points || k<cal->n_kept)
+     {
+     c = i==cal->n_points ? 1 : k==cal->n_kept ? -1 : compare_points(&cal->points[i], &cal->kept[k].point);
+     if(c<=0)
+       {
+       record.point = cal->points[i];
+       record.counts = counts[i++];
+       if(!c) { k++; }
+       }
+     else { record = cal->kept[k++]; }
+     fwrite(&record, sizeof(record), 1, out);
+     header->n_points++;
+     }
+fseek(out, 0, SEEK_SET);
+fwrite(header, sizeof(*header), 1, out);
+if(fclose(out)) { unlink(filename); return -1; }
+return 0;
+} /* end of write_grid_file() */
+
+
+/* refits the tool's models in models to the proteome in filename; returns the number of models
+   refitted, or -1 if the file cannot be read. With grid_file, the counts of the grid points are
+   read from and kept in it (see above). A summary of each fit is written to report */
+int calibrate_models(enum parameter_tool tool, const char *filename, const char *grid_file, int n_threads,
+                     struct parameter_models *models, FILE *report)
+{
+struct calibration cal;
+struct calibration_state *state;
+struct grid_header header;
+struct point_counts *counts;
+char *known;
+long sequences=0, kept_sequences=0;
+int focus, i, g, t, b, fitted=0, result=0, keep=0;
+
+memset(&cal, 0, sizeof(cal));
+cal.tool = tool;
+cal.n_threads = n_threads;
+build_grid(&cal, models);
+counts = calloc(cal.n_points, sizeof(struct point_counts));
+known = calloc(cal.n_points, 1);
+if(grid_file && !(keep = grid_header(tool, filename, &header)))
+  { fprintf(report, "# grid counts are kept only for a FASTA file, not for %s\n", filename); }
+if(keep) { kept_sequences = read_grid_file(&cal, grid_file, &header, counts, known); }
+cal.scan_points = malloc(cal.n_points*sizeof(int));
+for(i=0; i<cal.n_points; i++) { if(!known[i]) { cal.scan_points[cal.n_scan++] = i; } }
+group_points(&cal);
+fprintf(report, "# calibrating %d %s models with %d grid points in %d groups\n",
+        2*NUMBER_OF_COVERAGES, tool_name[tool], cal.n_points, cal.n_groups);
+if(keep) { fprintf(report, "# %d of the grid points counted already in %s\n", cal.n_points-cal.n_scan, grid_file); }
+
+cal.states = calloc(n_threads, sizeof(struct calibration_state));
+for(t=0; t<n_threads; t++)
+   {
+   state = &cal.states[t];
+   state->counts = t ? calloc(cal.n_points, sizeof(struct point_counts)) : counts;
+   if(tool==SEG)
+     {
+     state->seg = malloc(cal.n_groups*sizeof(struct seg_scanner *));
+     for(g=0; g<cal.n_groups; g++) { state->seg[g] = seg_create(cal.points[cal.scan_points[cal.group_start[g]]].window, 0.0, 0.0); }
+     }
+   else {
+        state->flps = malloc(cal.n_groups*sizeof(struct flps_scanner *));
+        for(g=0; g<cal.n_groups; g++) { state->flps[g] = t ? flps_clone(cal.flps[g]) : cal.flps[g]; }
+        }
+   }
+
+/* the proteome need not be read at all if every point has its counts */
+if(cal.n_scan) { result = scan_fasta(filename, n_threads, calibrate_record, &cal, report); }
+else { sequences = kept_sequences; }
+
+/* add up the threads' counts into the first's, which started with the counts kept */
+for(t=0; t<n_threads; t++)
+   {
+   sequences += cal.states[t].sequences;
+   for(i=0; t && i<cal.n_points; i++)
+      {
+      counts[i].covered += cal.states[t].counts[i].covered;
+      counts[i].regions += cal.states[t].counts[i].regions;
+      counts[i].sum_length += cal.states[t].counts[i].sum_length;
+      counts[i].sum_length2 += cal.states[t].counts[i].sum_length2;
+      for(b=0; b<LENGTH_BINS; b++) { counts[i].histogram[b] += cal.states[t].counts[i].histogram[b]; }
+      }
+   }
+if(result>=0 && keep && write_grid_file(&cal, grid_file, &header, counts, sequences)<0)
+  { fprintf(report, "# cannot write the grid counts to %s\n", grid_file); }
+if(result>=0)
+  {
+  fprintf(report, "# %ld sequences\n", sequences);
+  for(focus=DIVERSE; sequences && focus<=NARROW; focus++)
+     for(i=0; i<NUMBER_OF_COVERAGES; i++)
+        { fitted += fit_model(&cal, counts, sequences, focus, i, &models->model[tool][focus][i], report); }
+  }
+
+for(t=n_threads-1; t>=0; t--)
+   {
+   state = &cal.states[t];
+   for(g=0; g<cal.n_groups; g++)
+      {
+      if(tool==SEG) { seg_free(state->seg[g]); }
+      else { flps_free(state->flps[g]); }
+      }
+   free(state->seg);
+   free(state->flps);
+   free(state->counts);
+   }
+for(focus=DIVERSE; focus<=NARROW; focus++)
+   for(i=0; i<NUMBER_OF_COVERAGES; i++) { free(cal.model_points[focus][i]); }
+free(cal.states);
+free(cal.flps);
+free(cal.points);
+free(cal.scan_points);
+free(cal.group_start);
+free(cal.kept);
+free(known);
+return result<0 ? -1 : fitted;
+} /* end of calibrate_models() */
+
+/******** END OF CODE FILE ********/
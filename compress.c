@@ -0,0 +1,488 @@
+/****
+ **** compress.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Compressed FASTA input, recognised by its first bytes whatever the file is called, and
+ ****  handed to the reader (fasta.c) in order with decompress_read(), as a stream would be:
+ ****
+ ****    gzip  read with zlib as a stream, in the calling thread; concatenated members are read
+ ****          one after another, as gzip itself does
+ ****    BGZF  the blocked gzip of bgzip and samtools, whose members are independent and at most
+ ****          64 KiB, with their sizes in their headers: whole blocks are read ahead in jobs of
+ ****          about JOB_BYTES, which worker threads (one for every DECOMPRESS_SHARE threads
+ ****          scanning, and at least one) inflate while the calling thread goes on reading,
+ ****          and scanning, the ones before
+ ****    zstd  only with HAVE_ZSTD (make ZSTD=1): input made of many frames (from pzstd, or files
+ ****          compressed in pieces and concatenated) is decompressed in jobs of whole frames on
+ ****          worker threads, as BGZF is; if the first frame is more than MAX_FRAME_BYTES, as
+ ****          with one large frame from zstd itself, the input is decompressed as a stream
+ ****
+ ****  The jobs in flight are a ring of JOBS_PER_THREAD per worker, so memory use is bounded
+ ****  by the jobs, not the size of the input. Damaged or truncated input is an error, which
+ ****  decompress_read() reports once the data before it has been read.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+#include "scan.h"
+
+#define READ_BYTES (1<<16)
+#define JOB_BYTES (1<<18)          /* compressed input per job */
+#define JOBS_PER_THREAD 4
+#define MAX_FRAME_BYTES (1<<24)
+#define BGZF_HEADER 18
+#define BGZF_FOOTER 8              /* CRC32 and ISIZE */
+#define BGZF_MAX_ISIZE (1<<16)
+#define DECOMPRESS_SHARE 4         /* a worker for every DECOMPRESS_SHARE threads scanning */
+
+struct decompress_job {
+  unsigned char *input;
+  size_t input_size, input_used;
+  char *output;
+  size_t output_size, output_used;
+  int done, error;
+};
+
+struct decompressor {
+  enum compression type;
+  FILE *in;
+  unsigned char *ahead;            /* input read but not yet used */
+  size_t ahead_size, ahead_start, ahead_end;
+  int end_of_input, error;
+
+  /* as a stream */
+  z_stream z;
+  int in_member;                   /* part way through a gzip member */
+#ifdef HAVE_ZSTD
+  ZSTD_DCtx *zd;
+#endif
+
+  /* in parallel: job number % max_jobs is its place in the ring */
+  int n_threads, max_jobs, end_of_jobs, finished;
+  struct decompress_job *jobs;
+  long next_job, next_claim, next_output;
+  size_t output_position;          /* in the output of job next_output */
+  pthread_t *threads;
+  pthread_mutex_t lock;            /* guards next_job, next_claim, finished and the jobs' done flags */
+  pthread_cond_t work, done;
+};
+
+
+static int is_bgzf(const unsigned char *p, size_t n)
+{
+return n>=BGZF_HEADER && p[0]==0x1f && p[1]==0x8b && p[2]==8 && (p[3] & 4)
+       && p[10]==6 && p[11]==0 && p[12]=='B' && p[13]=='C' && p[14]==2 && p[15]==0;
+} /* end of is_bgzf() */
+
+
+/* the compression of input that starts with the n bytes at p */
+enum compression detect_compression(const unsigned char *p, size_t n)
+{
+if(is_bgzf(p, n)) { return BGZF; }
+if(n>=2 && p[0]==0x1f && p[1]==0x8b) { return GZIP; }
+if(n>=4 && p[0]==0x28 && p[1]==0xb5 && p[2]==0x2f && p[3]==0xfd) { return ZSTD; }
+return UNCOMPRESSED;
+} /* end of detect_compression() */
+
+
+/* makes at least n bytes of input available at ahead+ahead_start, unless it ends first;
+   returns the number available */
+static size_t read_ahead(struct decompressor *d, size_t n)
+{
+size_t available=d->ahead_end-d->ahead_start, got, want;
+
+if(available>=n || d->end_of_input) { return available; }
+memmove(d->ahead, d->ahead+d->ahead_start, available);
+d->ahead_start = 0;
+d->ahead_end = available;
+if(n>d->ahead_size) { d->ahead_size = n; d->ahead = realloc(d->ahead, d->ahead_size); }
+while(d->ahead_end<n)
+     {
+     want = d->ahead_size-d->ahead_end;
+     if(want>READ_BYTES && n-d->ahead_end<READ_BYTES) { want = READ_BYTES; }
+     if(!(got = fread(d->ahead+d->ahead_end, 1, want, d->in))) { d->end_of_input=1; break; }
+     d->ahead_end += got;
+     }
+return d->ahead_end;
+} /* end of read_ahead() */
+
+
+/*  *  *  * AS A STREAM *  *  *  */
+
+static long gzip_read(struct decompressor *d, char *buffer, size_t size)
+{
+size_t available;
+int status;
+
+d->z.next_out = (Bytef *) buffer;
+d->z.avail_out = size;
+while(d->z.avail_out && (available = read_ahead(d, 1)))
+     {
+     d->z.next_in = d->ahead+d->ahead_start;
+     d->z.avail_in = available;
+     status = inflate(&d->z, Z_NO_FLUSH);
+     d->ahead_start += available-d->z.avail_in;
+     d->in_member = 1;
+     if(status==Z_STREAM_END) { inflateReset(&d->z); d->in_member=0; }
+     else if(status!=Z_OK) { d->error=1; break; }
+     }
+if(!d->error && d->z.avail_out && d->in_member) { d->error=1; }  /* truncated */
+if(d->error && d->z.avail_out==size) { return -1; }
+return size-d->z.avail_out;
+} /* end of gzip_read() */
+
+
+#ifdef HAVE_ZSTD
+static long zstd_read(struct decompressor *d, char *buffer, size_t size)
+{
+ZSTD_outBuffer out={buffer, size, 0};
+ZSTD_inBuffer in;
+size_t remaining=1, before;
+
+while(out.pos<size)
+     {
+     in.src = d->ahead+d->ahead_start;
+     in.size = read_ahead(d, 1);
+     in.pos = 0;
+     before = out.pos;
+     remaining = ZSTD_decompressStream(d->zd, &out, &in);
+     d->ahead_start += in.pos;
+     if(ZSTD_isError(remaining)) { d->error=1; break; }
+     if(!in.size && out.pos==before) { break; }  /* the end of the input, and of what was held back */
+     }
+if(!d->error && out.pos<size && remaining) { d->error=1; }  /* truncated */
+if(d->error && !out.pos) { return -1; }
+return out.pos;
+} /* end of zstd_read() */
+#endif
+
+
+/*  *  *  * IN PARALLEL *  *  *  */
+
+/* the uncompressed size of a BGZF block of size bytes, from its last 4 bytes */
+static size_t bgzf_isize(const unsigned char *p, size_t size)
+{
+return p[size-4] | p[size-3]<<8 | p[size-2]<<16 | (size_t) p[size-1]<<24;
+} /* end of bgzf_isize() */
+
+
+/* the size of the next whole BGZF block or zstd frame, read ahead; 0 at the end of input, -1 if
+   the input is damaged. A BGZF block must hold its header and footer, and at most 64 KiB, so
+   that a job's blocks can be inflated without checking them again */
+static long next_block(struct decompressor *d)
+{
+size_t available=read_ahead(d, BGZF_HEADER), size;
+
+if(!available) { return 0; }
+if(d->type==BGZF)
+  {
+  if(!is_bgzf(d->ahead+d->ahead_start, available)) { return -1; }
+  size = (d->ahead[d->ahead_start+16] | d->ahead[d->ahead_start+17]<<8) + 1;
+  if(size<BGZF_HEADER+BGZF_FOOTER || read_ahead(d, size)<size
+     || bgzf_isize(d->ahead+d->ahead_start, size)>BGZF_MAX_ISIZE) { return -1; }
+  return size;
+  }
+#ifdef HAVE_ZSTD
+for(;;)
+   {
+   size = ZSTD_findFrameCompressedSize(d->ahead+d->ahead_start, available);
+   if(!ZSTD_isError(size)) { return size; }
+   if(ZSTD_getErrorCode(size)!=ZSTD_error_srcSize_wrong || read_ahead(d, 2*available)==available) { return -1; }
+   available = d->ahead_end-d->ahead_start;
+   }
+#endif
+return -1;
+} /* end of next_block() */
+
+
+/* reads whole blocks or frames into the job, to about JOB_BYTES; returns 0 at the end of input.
+   At damaged input, the job ends with the sound blocks before it, which are still decompressed
+   so that their data is read before the error */
+static int read_job(struct decompressor *d, struct decompress_job *job)
+{
+long size=0;
+
+job->input_used = 0;
+while(job->input_used<JOB_BYTES && (size = next_block(d))>0)
+     {
+     if(job->input_used+size>job->input_size)
+       {
+       job->input_size = job->input_used+size>2*job->input_size ? job->input_used+size : 2*job->input_size;
+       job->input = realloc(job->input, job->input_size);
+       }
+     memcpy(job->input+job->input_used, d->ahead+d->ahead_start, size);
+     job->input_used += size;
+     d->ahead_start += size;
+     }
+if(size<0) { d->error=1; }
+return job->input_used>0;
+} /* end of read_job() */
+
+
+/* returns -1 if the output cannot be made size bytes */
+static int grow_output(struct decompress_job *job, size_t size)
+{
+char *output;
+
+if(size<=job->output_size) { return 0; }
+if(!(output = realloc(job->output, size))) { return -1; }
+job->output = output;
+job->output_size = size;
+return 0;
+} /* end of grow_output() */
+
+
+/* inflates the BGZF blocks of a job, checked by next_block(), whose uncompressed sizes are in
+   their last 4 bytes; returns 0 if they are all sound */
+static int inflate_job(struct decompress_job *job, z_stream *z)
+{
+const unsigned char *p, *end=job->input+job->input_used;
+size_t size, total=0;
+
+for(p=job->input; p<end; p+=size)
+   {
+   size = (p[16] | p[17]<<8) + 1;
+   total += bgzf_isize(p, size);
+   }
+if(grow_output(job, total+1)) { return 1; }
+z->next_out = (Bytef *) job->output;
+z->avail_out = total;
+for(p=job->input; p<end; p+=size)
+   {
+   size = (p[16] | p[17]<<8) + 1;
+   inflateReset(z);
+   z->next_in = (Bytef *) p;
+   z->avail_in = size;
+   if(inflate(z, Z_FINISH)!=Z_STREAM_END || z->avail_in) { return 1; }
+   }
+job->output_used = total-z->avail_out;
+return z->avail_out!=0;
+} /* end of inflate_job() */
+
+
+#ifdef HAVE_ZSTD
+/* decompresses the zstd frames of a job into an output buffer of their total content size, or
+   one grown as needed if a frame does not record its size */
+static int zstd_job(struct decompress_job *job, ZSTD_DCtx *zd)
+{
+ZSTD_inBuffer in={job->input, job->input_used, 0};
+ZSTD_outBuffer out;
+unsigned long long content;
+size_t size, total=0, remaining=1;
+int known=1;
+
+for(size=0; in.pos<in.size; in.pos+=size)
+   {
+   size = ZSTD_findFrameCompressedSize(job->input+in.pos, in.size-in.pos);
+   content = ZSTD_getFrameContentSize(job->input+in.pos, in.size-in.pos);
+   if(content==ZSTD_CONTENTSIZE_ERROR) { return 1; }
+   if(content==ZSTD_CONTENTSIZE_UNKNOWN) { known=0; }
+   else { total += content; }
+   }
+if(grow_output(job, known ? total+1 : 4*in.size)) { return 1; }
+
+in.pos = 0;
+ZSTD_DCtx_reset(zd, ZSTD_reset_session_only);
+out.dst = job->output;
+out.size = job->output_size;
+out.pos = 0;
+while(in.pos<in.size || remaining)
+     {
+     if(out.pos==out.size)
+       {
+       if(grow_output(job, 2*job->output_size)) { return 1; }
+       out.dst = job->output;
+       out.size = job->output_size;
+       }
+     remaining = ZSTD_decompressStream(zd, &out, &in);
+     if(ZSTD_isError(remaining) || (in.pos==in.size && remaining && out.pos<out.size)) { return 1; }
+     }
+job->output_used = out.pos;
+return 0;
+} /* end of zstd_job() */
+#endif
+
+
+static void *decompress_thread(void *arg)
+{
+struct decompressor *d=arg;
+struct decompress_job *job;
+z_stream z;
+#ifdef HAVE_ZSTD
+ZSTD_DCtx *zd=ZSTD_createDCtx();
+#endif
+
+memset(&z, 0, sizeof(z));
+inflateInit2(&z, 15+16);
+for(;;)
+   {
+   pthread_mutex_lock(&d->lock);
+   while(d->next_claim==d->next_job && !d->finished) { pthread_cond_wait(&d->work, &d->lock); }
+   if(d->next_claim==d->next_job) { pthread_mutex_unlock(&d->lock); break; }
+   job = &d->jobs[d->next_claim++ % d->max_jobs];
+   pthread_mutex_unlock(&d->lock);
+
+#ifdef HAVE_ZSTD
+   job->error = d->type==BGZF ? inflate_job(job, &z) : zstd_job(job, zd);
+#else
+   job->error = inflate_job(job, &z);
+#endif
+
+   pthread_mutex_lock(&d->lock);
+   job->done=1;
+   pthread_cond_broadcast(&d->done);
+   pthread_mutex_unlock(&d->lock);
+   }
+inflateEnd(&z);
+#ifdef HAVE_ZSTD
+ZSTD_freeDCtx(zd);
+#endif
+return NULL;
+} /* end of decompress_thread() */
+
+
+/* keeps every free place in the ring busy with a job, then copies out the output of the jobs in
+   order as they are finished */
+static long parallel_read(struct decompressor *d, char *buffer, size_t size)
+{
+struct decompress_job *job;
+size_t n=0, chunk;
+
+while(n<size)
+     {
+     while(!d->end_of_jobs && d->next_job-d->next_output<d->max_jobs)
+          {
+          job = &d->jobs[d->next_job%d->max_jobs];
+          job->done = 0;
+          if(!read_job(d, job)) { d->end_of_jobs=1; break; }
+          pthread_mutex_lock(&d->lock);
+          d->next_job++;
+          pthread_cond_signal(&d->work);
+          pthread_mutex_unlock(&d->lock);
+          }
+     if(d->next_output==d->next_job) { break; }
+
+     job = &d->jobs[d->next_output%d->max_jobs];
+     pthread_mutex_lock(&d->lock);
+     while(!job->done) { pthread_cond_wait(&d->done, &d->lock); }
+     pthread_mutex_unlock(&d->lock);
+     if(job->error) { d->error=1; d->end_of_jobs=1; d->next_output=d->next_job; break; }
+
+     chunk = job->output_used-d->output_position<size-n ? job->output_used-d->output_position : size-n;
+     memcpy(buffer+n, job->output+d->output_position, chunk);
+     n += chunk;
+     d->output_position += chunk;
+     if(d->output_position==job->output_used) { d->next_output++; d->output_position=0; }
+     }
+return d->error && !n ? -1 : (long) n;
+} /* end of parallel_read() */
+
+
+/*  *  *  * OPENING AND READING *  *  *  */
+
+/* a decompressor of input of the given type from in, whose first n bytes have already been read
+   into start, for a reader scanning with n_threads threads. Returns NULL for zstd without
+   HAVE_ZSTD */
+struct decompressor *decompress_open(FILE *in, const unsigned char *start, size_t n, enum compression type,
+                                     int n_threads)
+{
+struct decompressor *d;
+size_t first;
+int t;
+
+#ifndef HAVE_ZSTD
+if(type==ZSTD) { return NULL; }
+#endif
+d = calloc(1, sizeof(struct decompressor));
+d->type = type;
+d->in = in;
+d->ahead_size = n>JOB_BYTES ? n : JOB_BYTES;
+d->ahead = malloc(d->ahead_size);
+memcpy(d->ahead, start, n);
+d->ahead_end = n;
+
+if(type==GZIP)
+  {
+  inflateInit2(&d->z, 15+16);
+  return d;
+  }
+#ifdef HAVE_ZSTD
+if(type==ZSTD)
+  {
+  /* the frames are decompressed in parallel if the first can be read ahead whole */
+  while(ZSTD_isError(first = ZSTD_findFrameCompressedSize(d->ahead, d->ahead_end))
+        && ZSTD_getErrorCode(first)==ZSTD_error_srcSize_wrong && d->ahead_end<MAX_FRAME_BYTES
+        && read_ahead(d, 2*d->ahead_end+READ_BYTES)>n) { n = d->ahead_end; }
+  if(ZSTD_isError(first)) { d->zd = ZSTD_createDCtx(); return d; }
+  }
+#else
+(void) first;
+#endif
+
+/* inflating is several times faster than scanning, so a few threads keep up with many scanning */
+d->n_threads = 1 + (n_threads>1 ? n_threads/DECOMPRESS_SHARE : 0);
+d->max_jobs = JOBS_PER_THREAD*d->n_threads;
+d->jobs = calloc(d->max_jobs, sizeof(struct decompress_job));
+d->threads = malloc(d->n_threads*sizeof(pthread_t));
+pthread_mutex_init(&d->lock, NULL);
+pthread_cond_init(&d->work, NULL);
+pthread_cond_init(&d->done, NULL);
+for(t=0; t<d->n_threads; t++) { pthread_create(&d->threads[t], NULL, decompress_thread, d); }
+return d;
+} /* end of decompress_open() */
+
+
+/* reads up to size bytes of the decompressed input into buffer; returns the number read, which is
+   less than size only at the end of input, or -1 if the input is damaged or truncated */
+long decompress_read(struct decompressor *d, char *buffer, size_t size)
+{
+if(d->n_threads) { return parallel_read(d, buffer, size); }
+#ifdef HAVE_ZSTD
+if(d->zd) { return zstd_read(d, buffer, size); }
+#endif
+return gzip_read(d, buffer, size);
+} /* end of decompress_read() */
+
+
+/* stops the worker threads and frees the decompressor; the stream it reads is left open */
+void decompress_close(struct decompressor *d)
+{
+int i;
+
+if(d->n_threads)
+  {
+  pthread_mutex_lock(&d->lock);
+  d->finished=1;
+  pthread_cond_broadcast(&d->work);
+  pthread_mutex_unlock(&d->lock);
+  for(i=0; i<d->n_threads; i++) { pthread_join(d->threads[i], NULL); }
+  for(i=0; i<d->max_jobs; i++) { free(d->jobs[i].input); free(d->jobs[i].output); }
+  free(d->jobs);
+  free(d->threads);
+  pthread_mutex_destroy(&d->lock);
+  pthread_cond_destroy(&d->work);
+  pthread_cond_destroy(&d->done);
+  }
+else if(d->type==GZIP) { inflateEnd(&d->z); }
+#ifdef HAVE_ZSTD
+if(d->zd) { ZSTD_freeDCtx(d->zd); }
+#endif
+free(d->ahead);
+free(d);
+} /* end of decompress_close() */
+
+/******** END OF CODE FILE ********/
@@ -11,8 +11,6 @@
  ****  or compositionally-biased region in proteins.  
  **** 
  ****  to compile: 
- ****   gcc -O2 -o fLPSparameters fLPSparameters.c -lm 
- ****    OR 
  ****   make 
  ****
  ****  to run and get help: 
@@ -45,14 +43,28 @@
 #include <math.h> 
 #include <ctype.h> 
 #include <unistd.h> 
+#include "parameters.h" 
+#include "scan.h" 
 
-enum calculation_type {DIVERSE, NARROW} focus;  
-char focus_name[3][10] = {"DIVERSE", "NARROW"}; 
-
-int small_m, big_m, max_m; 
+enum calculation_type focus[2] = {DIVERSE};  
+int n_focus=1; 
 int target_length=-1; 
-int not_valid; 
-double threshold; 
+int lengths[MAX_REQUEST_LENGTHS], n_lengths=0; 
+int batch; 
+enum output_format format=TEXT_FORMAT; 
+char *scan_file; 
+int one_pass; 
+int n_threads=1; 
+char *calibration_file; 
+int write_coefficients; 
+char *service_path; 
+int max_window;  /* -B: the largest window allowed, or 0 */ 
+int region_lengths;  /* -r: the expected distribution of region lengths with each set */ 
+char *summary_file;  /* -I */ 
+struct summary_index *summary; 
+const struct parameter_models *models;  /* read or mapped with -c; otherwise the built-in tables are used */ 
+int coverages[MAX_REQUEST_COVERAGES] = {2, 5, 10, 25, 40}, n_coverages=NUMBER_OF_COVERAGES; 
+char *program_name; 
 
 void print_help()
 {
@@ -61,11 +73,53 @@ fprintf(stderr,   "=============================================================
 "The program options are:\n"
 " -h   prints help\n"
 " -f   focus of the parameters\n"
-"      values: 'diverse' or 'narrow'; \n"
+"      values: 'diverse', 'narrow' or 'both'; \n"
 "      diverse = more diversity or variance of length is allowed (DEFAULT)\n"
 "      narrow  = narrowest focus on a particular target length\n"
+"      both    = output the parameters for both focuses\n"
 " -l   target length.\n" 
-"      This must be in the range 5-300 inclusive.\n\n"
+"      This must be in the range 5-300 inclusive.\n"
+"      A list of lengths and ranges can also be given, e.g. -l 5-300 or -l 10,15,20-30\n"
+" -b   batch mode: read requests from standard input, one per line, as a target length\n"
+"      optionally followed by a focus (e.g. '15 narrow'), or else the focus of -f; lines\n"
+"      starting with '#' are skipped. Not with -l\n"
+" -o   output format\n"
+"      values: 'text' (DEFAULT), 'tsv', 'json' or 'binary'; \n"
+"      tsv    = one headerless tab-separated row per parameter set: tool, focus, coverage,\n"
+"               target length, the three parameters ('NA' if not valid) and a reason code\n"
+"      json   = the same fields as one JSON object per line\n"
+"      binary = packed 40-byte little-endian records, laid out as described in format.c\n"
+"      The reason code is 0 for valid sets, otherwise the sum of: 1 = target length out of bounds,\n"
+"      4 = t>0.001, 8 = m<5, 16 = combination excluded, 32 = no model for this coverage, 64 = m>M\n"
+" -s   scan a FASTA file (or '-' for standard input) for single-residue compositional biases fLPS-style,\n"
+"      using each chosen parameter set in turn, and output the biased regions found\n"
+"      With '-', FASTA is read from a pipe and the regions written out as it goes, in memory bounded\n"
+"      by the longest sequence, e.g. zcat proteome.fasta.gz | fLPSparameters -l 15 -s - > regions.out;\n"
+"      all the chosen coverage levels are then scanned for in one pass, as with -a\n"
+"      The file can be compressed with gzip, bgzip or (if built with 'make ZSTD=1') zstd\n"
+" -p   coverage levels to output or scan with, e.g. -p 2,10 (DEFAULT: all of 2,5,10,25,40); any level\n" 
+"      from 2 to 40 can be given, e.g. -p 15,30, and is interpolated between the fitted ones\n"
+" -a   scan with all the chosen coverage levels in a single pass; each region is labelled\n"
+"      with the coverage levels whose parameters found it, e.g. '~2%%,~5%%'\n"
+" -t   number of threads to scan with (DEFAULT: 1); the output is the same for any number\n"
+" -c   read the parameter models from a coefficient file, text or binary, such as one written by -C or -w\n"
+" -C   calibrate the models against a proteome (a FASTA file): scan it with a grid of parameters\n"
+"      around each model, refit the fLPS models to the coverage and region lengths found, and\n"
+"      write them out as a coefficient file for -c (in binary with -o binary)\n" 
+" -w   write the models in use (built-in, or from -c) as a coefficient file, in binary with -o binary\n" 
+" -B   window budget: list the target lengths, for the chosen focus and coverage levels (-p), whose\n" 
+"      parameters are valid with M at most the value given, e.g. -B 20; -l limits the lengths tried\n" 
+" -r   also give the expected lengths of the regions each parameter set finds: their mean, variance\n" 
+"      and histogram (the proportions of 1-9, 10-19, 20-39, 40-79, 80-159, 160-319, 320-639 and\n" 
+"      640+ residues); these need models calibrated with -C (see lengths.c), and are NA otherwise\n" 
+" -I   keep a summary index of the FASTA file scanned (-s) in the file given, built on first use\n" 
+"      (and again if the FASTA file changes); later scans, with other parameters, then read only\n" 
+"      the sequences that can have regions, e.g. -s proteome.fasta -I proteome.flps.index\n" 
+"      With -C, keep the counts of the calibration grid in it instead, so that calibrating the\n" 
+"      same proteome again scans for only the grid points not counted before\n" 
+" -D   run as a parameter service on the Unix domain socket given, until interrupted: clients\n" 
+"      send 8-byte binary queries and get back 40-byte records (see server.c), for either tool,\n" 
+"      from the models in use\n\n"
 " The program outputs lists of suitable parameters for a given target length for low-complexity or compositionally-biased regions.\n"
 " There are sets of parameters output for estimated protein coverage of approximately 2%%, 5%%, 10%%, 25%%, and 40%%.\n"
 " The protein coverage is simply the proportion of proteins that are expected to be annotated or 'covered' when you choose\n"
@@ -73,7 +127,11 @@ fprintf(stderr,   "=============================================================
 " For some combinations of coverage level and target lengths, sets of parameters cannot be output because they are out of bounds.\n"
 " This is an example of running the program:\n"
 "        ./fLPSparameters -f diverse -l 15 > parameters.out\n\n"
-" Here, diverse focus is specified with a target region length of 15 residues.\n\n"
+" Here, diverse focus is specified with a target region length of 15 residues.\n"
+" Many requests can be answered in one run, e.g.:\n"
+"        ./fLPSparameters -f both -l 5-300 > parameters.out\n"
+" and the parameters can be applied directly to a set of proteins, e.g.:\n"
+"        ./fLPSparameters -l 15 -s proteome.fasta > regions.out\n\n"
 "CITATION:\n"
 " Harrison, PM. 'Optimal strategies for discovery of low-complexity or compositionally-biased regions',\n"
 " submitted. \n" 
@@ -81,42 +139,280 @@ fprintf(stderr,   "=============================================================
 } /* end of print_help() */ 
 
 
-void output_parameters(int upper_bound, int coverage)
+struct parameter_set choose_parameters(enum calculation_type focus, int target_length, int coverage)
+{
+if(models) { return evaluate_model(models, FLPS, focus, target_length, coverage); } 
+return lookup_parameters(FLPS, focus, target_length, coverage); 
+} /* end of choose_parameters() */ 
+
+
+/* the expected lengths of the regions a valid set finds, after its parameters (-r) */
+void output_lengths(struct parameter_set *ps)
+{
+struct length_distribution d; 
+int bin; 
+
+predict_lengths(models ? models : &builtin_models, ps, &d); 
+if(d.known>=LENGTHS_MEAN) { fprintf(stdout, "\t%.1lf", d.mean); } 
+else { fprintf(stdout, "\tNA"); } 
+if(d.known<LENGTHS_FULL) { fprintf(stdout, "\tNA\tNA"); return; } 
+fprintf(stdout, "\t%.1lf\t", d.variance); 
+for(bin=0; bin<LENGTH_BINS; bin++) { fprintf(stdout, "%s%.0lf%%", bin ? "," : "", 100.0*d.histogram[bin]); } 
+} /* end of output_lengths() */ 
+
+
+void output_parameters(struct parameter_set *ps)
 {
-if(target_length<5 || target_length>upper_bound) { not_valid=1; }
-if(threshold>-3.0) { not_valid=1; } 
-if(small_m<5) { not_valid=1; }
-
-if(target_length<50 && focus==NARROW && coverage==25) { not_valid=1; } 
-if(target_length<100 && focus==NARROW && coverage==40) { not_valid=1; } 
-if(target_length<=15 && focus==DIVERSE && coverage==40) { not_valid=1; } 
-if(target_length<=10 && focus==NARROW) { not_valid=1; } 
-
-if(!not_valid) 
-  { fprintf(stdout, "\t~%d%%\t\t\t%d\t%d\t%.1le\n", coverage, small_m, big_m, (double) pow(10.0, threshold) ); } 
-else { /*not valid*/ fprintf(stdout, "\t~%d%%\t\t\tNA [ target length <5 OR >%d, OR t>0.001]\n", coverage, upper_bound); } 
+if(!ps->not_valid) 
+  { 
+  fprintf(stdout, "\t~%d%%\t\t\t%d\t%d\t%.1le", ps->coverage, ps->small_m, ps->big_m, (double) pow(10.0, ps->threshold) ); 
+  if(region_lengths) { output_lengths(ps); } 
+  fprintf(stdout, "\n"); 
+  } 
+else { /*not valid*/ fprintf(stdout, "\t~%d%%\t\t\tNA [ target length <%d OR >%d, OR t>0.001]\n", ps->coverage, ps->lower_bound, ps->upper_bound); } 
 } /* end of output_parameters() */ 
 
 
+void output_request(int target_length, enum calculation_type focus)
+{
+int i; 
+struct parameter_set ps; 
+struct length_distribution d; 
+
+if(format!=TEXT_FORMAT) 
+  { 
+  for(i=0; i<n_coverages; i++) 
+     { 
+     ps = choose_parameters(focus, target_length, coverages[i]); 
+     if(!region_lengths) { write_parameters(stdout, &ps, format); continue; } 
+     predict_lengths(models ? models : &builtin_models, &ps, &d); 
+     write_parameters_lengths(stdout, &ps, &d, format); 
+     } 
+  return; 
+  } 
+
+/*  *  *  * HEADER OF OUTPUT *  *  *  */ 
+fprintf(stdout, "\n%s has chosen the following parameters for target length %d and focus %s:\n\n", program_name, target_length, focus_name[focus]); 
+if(focus==DIVERSE)
+  { fprintf(stdout, "A DIVERSE focus means that a typical or average level of length variance for the annotated regions is allowed.\n"); } 
+else { fprintf(stdout, "A NARROW focus means that length variance is minimized for the annotated regions.\n"); } 
+fprintf(stdout, "\tEstimated_coverage\tm\tM\tt%s:\n", region_lengths ? "\tMean_length\tVariance\tLength_histogram" : ""); 
+fprintf(stdout, "\t------------------\t-\t-\t--%s\n", region_lengths ? "\t-----------\t--------\t----------------" : ""); 
+
+/*  *  *  * CALCULATE THE PARAMETERS *  *  *  */ 
+for(i=0; i<n_coverages; i++) 
+   { 
+   ps = choose_parameters(focus, target_length, coverages[i]); 
+   output_parameters(&ps); 
+   } 
+} /* end of output_request() */ 
+
+
+/* the scanner and buffers of one scanning thread */ 
+struct scan_state { 
+  struct flps_scanner *flps; 
+  struct region_list regions[MAX_PARAMETER_SETS], merged; 
+}; 
+
+struct scan_context { 
+  struct parameter_set *ps; 
+  int n; 
+  struct scan_state *states;  /* one per thread */ 
+}; 
+
+
+/* scans one sequence with all the sets, listing the regions found to out */ 
+void scan_record(void *context, int thread, const struct fasta_record *record, struct arena *arena, FILE *out)
+{
+struct scan_context *sc=context; 
+struct scan_state *state=&sc->states[thread]; 
+struct region *region; 
+char label[MAX_PARAMETER_SETS*5]; 
+unsigned char *codes=arena_alloc(arena, record->length); 
+int i, s, id_length; 
+
+encode_sequence(record->sequence, record->length, codes); 
+for(s=0; s<sc->n; s++) { start_regions(&state->regions[s], arena); } 
+start_regions(&state->merged, arena); 
+flps_scan(state->flps, codes, record->length, state->regions); 
+merge_labelled_regions(state->regions, sc->n, &state->merged); 
+
+for(id_length=0; id_length<record->header_length && !isspace(record->header[id_length]); id_length++) { ; } 
+for(i=0; i<state->merged.n; i++) 
+   { 
+   region = &state->merged.regions[i]; 
+   coverage_label(sc->ps, region->sets, label); 
+   fprintf(out, "%.*s\t%d\t%s\t%d\t%d\t{%c}\t%.1le\n", id_length, record->header, record->length, label, 
+           region->start+1, region->end, amino_acids[region->residue], pow(10.0, region->score)); 
+   } 
+} /* end of scan_record() */ 
+
+
+/* one pass of the fLPS scanner over scan_file, with n parameter sets at once; a region found 
+   identically by several sets is listed once */ 
+void scan_sets(struct parameter_set *ps, int n)
+{
+int s, t; 
+struct flps_set sets[MAX_PARAMETER_SETS]; 
+struct scan_context sc; 
+long *offsets=NULL; 
+int n_offsets=0, result; 
+
+for(s=0; s<n; s++) 
+   { sets[s].small_m = ps[s].small_m; sets[s].big_m = ps[s].big_m; sets[s].threshold = ps[s].threshold; } 
+sc.ps = ps; 
+sc.n = n; 
+sc.states = calloc(n_threads, sizeof(struct scan_state)); 
+if(!(sc.states[0].flps = flps_create(n, sets, background_frequencies))) 
+  { fprintf(stderr, " cannot scan with these parameters: each set needs 1 <= m <= M\n"); exit(1); } 
+for(t=1; t<n_threads; t++) { sc.states[t].flps = flps_clone(sc.states[0].flps); } 
+
+if(summary) 
+  { 
+  offsets = malloc((summary->n_sequences+1)*sizeof(long)); 
+  n_offsets = select_sequences(summary, ps, n, offsets); 
+  fprintf(stderr, "# %d of %d sequences to scan, from the summary index\n", n_offsets, summary->n_sequences); 
+  } 
+if((result = scan_fasta_selected(scan_file, offsets, n_offsets, n_threads, scan_record, &sc, stdout))<0) 
+  { 
+  if(result==SCAN_READ_ERROR) { fprintf(stderr, " FASTA file %s is truncated or damaged\n", scan_file); } 
+  else { fprintf(stderr, " cannot open FASTA file %s, or it is compressed in a way this build cannot read\n", scan_file); } 
+  exit(1); 
+  } 
+free(offsets); 
+
+for(t=n_threads-1; t>=0; t--)  /* the clones before the scanner they share tables with */
+   { 
+   flps_free(sc.states[t].flps); 
+   } 
+free(sc.states); 
+} /* end of scan_sets() */ 
+
+
+/* scans scan_file with the parameter set for each chosen coverage level, in separate passes or, with -a, in one */ 
+void scan_request(int target_length, enum calculation_type focus)
+{
+int i, n=0; 
+char t[16]; 
+struct parameter_set ps[MAX_REQUEST_COVERAGES]; 
+
+for(i=0; i<n_coverages; i++) 
+   { 
+   ps[n] = choose_parameters(focus, target_length, coverages[i]); 
+   if(ps[n].not_valid) 
+     { fprintf(stdout, "# target length %d, focus %s, ~%d%%: NA, not scanned\n", target_length, focus_name[focus], ps[n].coverage); continue; } 
+
+   /* scan with the threshold as printed, as a separate fLPS run would */ 
+   sprintf(t, "%.1le", pow(10.0, ps[n].threshold)); 
+   ps[n].threshold = log10(atof(t)); 
+   fprintf(stdout, "# target length %d, focus %s, ~%d%%: m=%d M=%d t=%s\n", target_length, focus_name[focus], ps[n].coverage, ps[n].small_m, ps[n].big_m, t); 
+   if(one_pass) { n++; } 
+   else { scan_sets(&ps[n], 1); } 
+   } /* end of for each coverage */ 
+if(n) { scan_sets(ps, n); } 
+} /* end of scan_request() */ 
+
+
+/* the target lengths for which the parameters are valid with a window M of at most max_window,
+   for each chosen coverage level */ 
+void solve_request(enum calculation_type focus)
+{
+int i, j, n, n_candidates, smallest, largest; 
+int candidates[MAX_REQUEST_LENGTHS], feasible_lengths[MAX_REQUEST_LENGTHS]; 
+struct parameter_set feasible[MAX_REQUEST_LENGTHS]; 
+
+if(n_lengths) { memcpy(candidates, lengths, n_lengths*sizeof(int)); n_candidates=n_lengths; } 
+else { for(n_candidates=0; n_candidates<=MAX_TARGET_LENGTH-MIN_TARGET_LENGTH; n_candidates++) { candidates[n_candidates] = MIN_TARGET_LENGTH+n_candidates; } } 
+
+if(format==TEXT_FORMAT) 
+  { 
+  fprintf(stdout, "\n%s: target lengths with valid parameters for focus %s and M at most %d:\n\n", program_name, focus_name[focus], max_window); 
+  fprintf(stdout, "\tEstimated_coverage\tM\tTarget_lengths\n"); 
+  fprintf(stdout, "\t------------------\t-\t--------------\n"); 
+  } 
+for(i=0; i<n_coverages; i++) 
+   { 
+   n = solve_parameters(models, FLPS, focus, max_window, &coverages[i], 1, candidates, n_candidates, feasible); 
+   if(format!=TEXT_FORMAT) 
+     { for(j=0; j<n; j++) { write_parameters(stdout, &feasible[j], format); } continue; } 
+   if(!n) { fprintf(stdout, "\t~%d%%\t\t\tnone\n", coverages[i]); continue; } 
+   for(j=0, smallest=largest=feasible[0].big_m; j<n; j++) 
+      { 
+      feasible_lengths[j] = feasible[j].target_length; 
+      if(feasible[j].big_m<smallest) { smallest = feasible[j].big_m; } 
+      if(feasible[j].big_m>largest) { largest = feasible[j].big_m; } 
+      } 
+   if(smallest==largest) { fprintf(stdout, "\t~%d%%\t\t\t%d\t", coverages[i], smallest); } 
+   else { fprintf(stdout, "\t~%d%%\t\t\t%d-%d\t", coverages[i], smallest, largest); } 
+   write_target_lengths(stdout, feasible_lengths, n); 
+   fprintf(stdout, "\n"); 
+   } /* end of for each coverage */ 
+} /* end of solve_request() */ 
+
+
+void answer_request(int target_length, enum calculation_type focus)
+{
+if(scan_file) { scan_request(target_length, focus); } 
+else { output_request(target_length, focus); } 
+} /* end of answer_request() */ 
+
+
 int main(int argc, char **argv)
 {
-int i, c, errflg=0; 
-int cov=-1;
+int i, j, c, errflg=0; 
+enum calculation_type request_focus[2]; 
+struct parameter_models calibrated; 
 
 extern char *optarg;
 extern int optind, optopt; 
 
 /*  *  *  *  PROCESS COMMAND-LINE OPTIONS  *  *  *  */ 
-while((c = getopt(argc, argv, "hf:l:")) != -1) { 
+while((c = getopt(argc, argv, "habrwB:c:f:l:o:p:s:t:C:D:I:")) != -1) { 
      switch(c) {
      case 'h': print_help(); exit(0);   
-     case 'f': if(!strcmp(optarg, "narrow")) { focus=NARROW; } 
-               else { focus=DIVERSE; } 
+     case 'a': one_pass=1; break; 
+     case 'b': batch=1; break; 
+     case 'o': if((c = parse_output_format(optarg))<0) 
+                 { fprintf(stderr, " -o value is not a known output format: %s\n", optarg); errflg++; } 
+               else { format=c; } 
+               break; 
+     case 's': scan_file=optarg; break; 
+     case 'c': if(!(models = open_models(optarg, &c)))
+                 {
+                 if(c==MODELS_CANNOT_OPEN) { fprintf(stderr, " cannot open coefficient file %s\n", optarg); }
+                 else if(c==MODELS_INCOMPATIBLE) { fprintf(stderr, " coefficient file %s was written by an incompatible version or machine\n", optarg); }
+                 else if(c==MODELS_NOT_VALID) { fprintf(stderr, " coefficient file %s has a model that is not valid (see models.c)\n", optarg); }
+                 else { fprintf(stderr, " coefficient file %s: line %d is not understood\n", optarg, c); }
+                 errflg++;
+                 }
+               break; 
+     case 'w': write_coefficients=1; break; 
+     case 'r': region_lengths=1; break; 
+     case 'I': summary_file=optarg; break; 
+     case 'C': calibration_file=optarg; break; 
+     case 'D': service_path=optarg; break; 
+     case 'B': if(sscanf(optarg, "%d", &max_window)!=1 || max_window<1) 
+                 { fprintf(stderr, " -B window budget must be a positive number: %s\n", optarg); errflg++; max_window=0; } 
                break; 
-     case 'l': sscanf(optarg,"%d", &target_length); 
+     case 't': if(sscanf(optarg, "%d", &n_threads)!=1 || n_threads<1 || n_threads>MAX_THREADS) 
+                 { fprintf(stderr, " -t number of threads must be in the range 1-%d: %s\n", MAX_THREADS, optarg); errflg++; } 
+               break; 
+     case 'p': if((n_coverages = parse_coverages(optarg, coverages, MAX_REQUEST_COVERAGES))<1) 
+                 { fprintf(stderr, " -p values must be at most %d coverages from 2 to 40: %s\n", MAX_REQUEST_COVERAGES, optarg); errflg++; } 
+               break; 
+     case 'f': n_focus = parse_focus(optarg, focus); break; 
+     case 'l': if(strpbrk(optarg+1, ",-")) 
+                 { 
+                 n_lengths = parse_target_lengths(optarg, lengths, MAX_REQUEST_LENGTHS); 
+                 if(n_lengths<0) { fprintf(stderr, " -l list of target lengths is malformed: %s\n", optarg); errflg++; } 
+                 else if(n_lengths==0) { fprintf(stderr, " -l list has no target lengths in the range 5-300\n"); errflg++; } 
+                 break; 
+                 } 
+               sscanf(optarg,"%d", &target_length); 
                if(target_length<5 || target_length>300) 
                  { fprintf(stderr, " -l value is out of bounds, re-setting to a DEFAULT VALUE = 15\n"); 
                    target_length=15; } 
+               lengths[0]=target_length; n_lengths=1; 
                break; 
      case ':': fprintf(stderr, "option -%c requires a value...\n", optopt); errflg++; break; 
      case '?': fprintf(stderr, "unrecognized option: -%c ...\n", optopt); errflg++; 
@@ -125,127 +421,78 @@ while((c = getopt(argc, argv, "hf:l:")) != -1) {
 if (errflg) { print_help(); exit(1); } 
 
 
-/*  *  *  * HEADER OF OUTPUT *  *  *  */ 
+program_name = argv[0]+2; 
 
-fprintf(stdout, "\n%s has chosen the following parameters for target length %d and focus %s:\n\n", argv[0]+2, target_length, focus_name[focus]); 
-if(focus==DIVERSE)
-  { fprintf(stdout, "A DIVERSE focus means that a typical or average level of length variance for the annotated regions is allowed.\n"); } 
-else { fprintf(stdout, "A NARROW focus means that length variance is minimized for the annotated regions.\n"); } 
-fprintf(stdout, "\tEstimated_coverage\tm\tM\tt:\n"); 
-fprintf(stdout, "\t------------------\t-\t-\t--\n"); 
+if(calibration_file) 
+  { 
+  calibrated = models ? *models : builtin_models; 
+  if(calibrate_models(FLPS, calibration_file, summary_file, n_threads, &calibrated, stderr)<0) 
+    { fprintf(stderr, " cannot open FASTA file %s\n", calibration_file); exit(1); } 
+  models = &calibrated; 
+  write_coefficients=1; 
+  } 
+if(write_coefficients) 
+  { 
+  if(format==BINARY_FORMAT) { write_models_binary(stdout, models ? models : &builtin_models); } 
+  else { write_models(stdout, models ? models : &builtin_models); } 
+  exit(0); 
+  } 
+if(service_path) 
+  { 
+  if(serve_parameters(service_path, models, stderr)<0) 
+    { fprintf(stderr, " cannot listen on socket %s\n", service_path); exit(1); } 
+  exit(0); 
+  } 
+if(max_window) 
+  { 
+  for(j=0; j<n_focus; j++) { solve_request(focus[j]); } 
+  exit(0); 
+  } 
 
 
-/*  *  *  * CALCULATE THE PARAMETERS *  *  *  */ 
-if(focus==DIVERSE)
+if(summary_file) 
+  { 
+  if(!scan_file || !strcmp(scan_file, "-")) { fprintf(stderr, " -I needs a FASTA file to scan (-s), not standard input\n"); exit(1); } 
+  if(!(summary = open_summary_index(summary_file, FLPS, scan_file, &c)) && (c==SUMMARY_CANNOT_OPEN || c==SUMMARY_STALE)) 
+    { 
+    fprintf(stderr, "# building the summary index %s of %s\n", summary_file, scan_file); 
+    if(build_summary_index(FLPS, scan_file, summary_file, n_threads)<0) 
+      { fprintf(stderr, " cannot read %s or write the summary index %s\n", scan_file, summary_file); exit(1); } 
+    summary = open_summary_index(summary_file, FLPS, scan_file, &c); 
+    } 
+  if(!summary) 
+    { fprintf(stderr, " %s is not a %s summary index that this build can use\n", summary_file, tool_name[FLPS]); exit(1); } 
+  } 
+
+
+/* standard input can only be read once, so all the chosen coverage levels are scanned for in one 
+   pass (as with -a), for one request; the output is written out in large blocks */ 
+if(scan_file && !strcmp(scan_file, "-")) 
+  { 
+  if(batch || n_lengths>1 || n_focus>1) 
+    { fprintf(stderr, " -s - reads standard input once, so it needs one target length (-l) and focus (-f), and not -b\n"); exit(1); } 
+  one_pass=1; 
+  setvbuf(stdout, NULL, _IOFBF, STREAM_OUTPUT_BYTES); 
+  } 
+
+
+/*  *  *  * OUTPUT THE PARAMETERS FOR EACH REQUEST *  *  *  */ 
+if(batch) 
   { 
-  /* 2% */ 
-  big_m = round(2.534 * pow((double) target_length, 0.506)); 
-  small_m = big_m - 2; 
-  threshold = -0.153 * (double) target_length - 3.994; 
-  max_m=100; cov=2; 
-  output_parameters(max_m, cov); 
-
-  /* 5% */ 
-  not_valid=0; 
-  big_m = round(3.46 * pow((double) target_length, 0.508)); 
-  small_m = big_m - 4; 
-  threshold = -0.098 * (double) target_length - 3.305; 
-  max_m=200; cov=5; 
-  output_parameters(max_m, cov); 
-
-  /* 10% */ 
-  not_valid=0; 
-  big_m = round(3.912 * pow((double) target_length, 0.543)); 
-  small_m = big_m - 10; 
-  threshold = -0.055 * (double) target_length - 3.635; 
-  max_m=250; cov=10; 
-  output_parameters(max_m, cov); 
-
-  /* 25% */ 
-  not_valid=0; 
-
-  if(target_length<=105)
-    {
-    big_m = round(5.647 * pow((double) target_length, 0.56)); 
-    small_m = round(0.872 * pow((double) target_length, 0.797)); 
-    threshold = -0.039 * (double) target_length - 2.381;
-    }
-  else { 
-       big_m = round(6.096 * pow((double) target_length, 0.552)); 
-       small_m = big_m - 50; 
-       threshold = -0.031 * (double) target_length - 2.93;
-       }
-
-   max_m=300; cov=25; 
-   output_parameters(max_m, cov);   
-
-  /* 40% */ 
-  not_valid=0; 
-
-  if(target_length<=105)
-    {
-    big_m = round(9.82 * pow((double) target_length, 0.522)); 
-    small_m = round(0.481 * pow((double) target_length, 0.876)); 
-    threshold = -0.022 * (double) target_length - 2.709;
-    }
-  else { 
-       big_m = round(11.126 * pow((double) target_length, 0.484)); 
-       small_m = big_m - 80; 
-       threshold = -0.025 * (double) target_length - 2.762;
-       }
-
-   max_m=300; cov=40; 
-   output_parameters(max_m, cov); 
-
-  } /* end of focus==DIVERSE */ 
-
-else { /* focus == NARROW */ 
-     /* 2% */ 
-     big_m = round(2.324 * pow((double) target_length, 0.539)); 
-     small_m = big_m; 
-     threshold = -0.149 * (double) target_length - 3.883; 
-     max_m=100; cov=2; 
-     output_parameters(max_m, cov); 
-
-     /* 5% */ 
-     not_valid=0; 
-     big_m = round(2.976 * pow((double) target_length, 0.556)); 
-     small_m = big_m; 
-     if(target_length<=28)
-       { threshold = -0.127 * (double) target_length - 2.183; }
-     else if(target_length>=33) { threshold = -0.09 * (double) target_length - 3.173; }
-     else { threshold = ((-0.127 * (double) target_length - 2.183) + (-0.09 * (double) target_length - 3.173))/2.0; } 
-     max_m=200; cov=5; 
-     output_parameters(max_m, cov); 
-
-     /* 10% */ 
-     not_valid=0; 
-     big_m = round(3.493 * pow((double) target_length, 0.572)); 
-     small_m = big_m; 
-     threshold = -0.058 * (double) target_length - 2.731; 
-     max_m=200; cov=10; 
-     output_parameters(max_m, cov); 
-
-     /* 25% */ 
-     not_valid=0; 
-     big_m = round(3.394 * pow((double) target_length, 0.672)); 
-     small_m = big_m; 
-     if(target_length<=90) { threshold = -4.0; } 
-     else { threshold = -0.028 * (double) target_length - 1.695; }
-     max_m=300; cov=25; 
-     output_parameters(max_m, cov); 
-
-     /* 40% */ 
-     not_valid=0; 
-     big_m = round(0.889 * pow((double) target_length, 0.977)); 
-     small_m = big_m; 
-     threshold = -4.0; 
-     max_m=300; cov=40; 
-     output_parameters(max_m, cov); 
-     } /* end of focus==NARROW */ 
+  if(n_lengths) { fprintf(stderr, " -b reads the target lengths from standard input, so it cannot be given -l as well\n"); exit(1); } 
+  while((c = read_request(stdin, focus, n_focus, &target_length, request_focus))) 
+       { for(j=0; j<c; j++) { answer_request(target_length, request_focus[j]); } } 
+  } 
+else if(n_lengths==0) 
+       { for(j=0; j<n_focus; j++) { answer_request(target_length, focus[j]); } } 
+else { 
+     for(i=0; i<n_lengths; i++) 
+        for(j=0; j<n_focus; j++) { answer_request(lengths[i], focus[j]); } 
+     } 
 
 
 /*  *  *  * FOOTER OF OUTPUT *  *  *  */ 
+if(format!=TEXT_FORMAT || scan_file) { exit(0); } 
 fprintf(stdout, "\n\nCoverage is the proportion of protein sequences expected to be labelled by these parameter sets.\n"); 
 fprintf(stdout, "\nIt is recommended to use all of the parameters progressively in separate runs of the fLPS program,\n"); 
 fprintf(stdout, " and compare the outputs.\n"); 
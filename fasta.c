@@ -0,0 +1,312 @@
+/****
+ **** fasta.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  FASTA input for the scanners, and the residue coding they share.
+ ****
+ ****  A regular file is memory-mapped, and each record is returned as a view into the mapping
+ ****  rather than copied out: the header is left where it is, and the sequence lines are
+ ****  compacted in place, to the start of the sequence, by removing the line breaks (16 bytes
+ ****  at a time with SSE2). The mapping is private, so the file itself is not changed, and the
+ ****  pages already scanned can be handed back with fasta_release() so that memory use does
+ ****  not grow with the size of the file. The reader can also be limited to records at given
+ ****  offsets in a mapped file (fasta_select()), which are then read without going through the
+ ****  rest of it.
+ ****  Standard input and other streams are read STREAM_BYTES at a time, and each record is
+ ****  copied out into buffers owned by the reader that are reused (and grown when needed) from
+ ****  one record to the next, so memory use is bounded by the longest record, however long the
+ ****  stream. The sequence lines are compacted as they are copied, as for a mapped file.
+ ****  Compressed input (gzip, BGZF or zstd, recognised by its first bytes) is read as a stream
+ ****  through a decompressor (compress.c), whether it is a file or standard input.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "scan.h"
+
+#define RELEASE_BYTES (1<<25)
+#define STREAM_BYTES (1<<16)
+#define BGZF_MAGIC_BYTES 18   /* enough to tell BGZF from other gzip */
+
+const char amino_acids[NUMBER_OF_RESIDUES+1] = "ACDEFGHIKLMNPQRSTVWY";
+unsigned char residue_code[256];
+
+
+static void init_residue_code(void)
+{
+static int initialised;
+int i;
+
+if(initialised) { return; }
+initialised=1;
+memset(residue_code, OTHER_RESIDUE, sizeof(residue_code));
+for(i=0; i<NUMBER_OF_RESIDUES; i++)
+   {
+   residue_code[(unsigned char) amino_acids[i]] = i;
+   residue_code[tolower(amino_acids[i])] = i;
+   }
+} /* end of init_residue_code() */
+
+
+void encode_sequence(const char *sequence, int length, unsigned char *codes)
+{
+int i;
+
+for(i=0; i<length; i++) { codes[i] = residue_code[(unsigned char) sequence[i]]; }
+} /* end of encode_sequence() */
+
+
+/* whether a regular file starts with the magic number of a compressed format */
+static int is_compressed(int fd)
+{
+unsigned char magic[BGZF_MAGIC_BYTES];
+ssize_t n=pread(fd, magic, sizeof(magic), 0);
+
+return n>0 && detect_compression(magic, n)!=UNCOMPRESSED;
+} /* end of is_compressed() */
+
+
+/* opens a FASTA file, or standard input for "-", for a caller that will scan it with n_threads
+   threads, which decides how many decompress it if it is compressed; returns NULL if it cannot be
+   opened or is compressed in a way this build cannot read */
+struct fasta_reader *fasta_open(const char *filename, int n_threads)
+{
+struct fasta_reader *fr;
+struct stat st;
+enum compression type;
+FILE *in;
+void *map;
+int fd;
+
+init_residue_code();
+if(strcmp(filename, "-"))
+  {
+  if((fd = open(filename, O_RDONLY))<0) { return NULL; }
+  if(!fstat(fd, &st) && S_ISREG(st.st_mode) && !is_compressed(fd))
+    {
+    fr = calloc(1, sizeof(struct fasta_reader));
+    if(st.st_size>0 && (map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0))!=MAP_FAILED)
+      {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      fr->map = map;
+      fr->map_size = st.st_size;
+      }
+    close(fd);
+    return fr;  /* an empty file has no records */
+    }
+  in = fdopen(fd, "r");
+  }
+else { in=stdin; }
+
+fr = calloc(1, sizeof(struct fasta_reader));
+fr->in = in;
+fr->header_size = 256;
+fr->header = malloc(fr->header_size);
+fr->sequence_size = 4096;
+fr->sequence = malloc(fr->sequence_size);
+fr->buffer = malloc(STREAM_BYTES);
+
+/* the first bytes read tell whether the stream is compressed, and are then the decompressor's */
+fr->buffer_end = fread(fr->buffer, 1, STREAM_BYTES, in);
+if((type = detect_compression((unsigned char *) fr->buffer, fr->buffer_end))!=UNCOMPRESSED)
+  {
+  if(!(fr->decompressor = decompress_open(in, (unsigned char *) fr->buffer, fr->buffer_end, type, n_threads)))
+    { fasta_close(fr); return NULL; }
+  fr->buffer_end = 0;
+  }
+return fr;
+} /* end of fasta_open() */
+
+
+static int is_skipped(int c) { return isspace(c) || c=='*'; }
+
+/* removes whitespace and '*' from the n characters at s, moving the rest up; returns the new length */
+static size_t compact_residues(char *s, size_t n)
+{
+size_t i=0, j=0;
+#ifdef __SSE2__
+__m128i v;
+int k, mask;
+
+for(; i+16<=n; i+=16)
+   {
+   v = _mm_loadu_si128((const __m128i *) (s+i));
+   mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t'-1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r'+1))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('*')))));
+   if(!mask)
+     {
+     if(j<i) { _mm_storeu_si128((__m128i *) (s+j), v); }
+     j+=16;
+     continue;
+     }
+   for(k=0; k<16; k++) { if(!(mask & 1<<k)) { s[j++] = s[i+k]; } }
+   }
+#endif
+for(; i<n; i++) { if(!is_skipped((unsigned char) s[i])) { s[j++] = s[i]; } }
+return j;
+} /* end of compact_residues() */
+
+
+/* the next record from a mapped file */
+static int map_next(struct fasta_reader *fr, struct fasta_record *record)
+{
+char *p=fr->map+fr->position, *end=fr->map+fr->map_size, *q;
+
+/* skip anything before the next header */
+if(!(p = memchr(p, '>', end-p))) { fr->position=fr->map_size; return 0; }
+
+record->offset = p-fr->map;
+p++;
+if(!(q = memchr(p, '\n', end-p))) { q=end; }
+record->header = p;
+record->header_length = q-p;
+if(q>p && q[-1]=='\r') { record->header_length--; }
+
+p = q<end ? q+1 : end;
+if(!(q = memchr(p, '>', end-p))) { q=end; }
+record->sequence = p;
+record->length = compact_residues(p, q-p);
+fr->position = q-fr->map;
+return 1;
+} /* end of map_next() */
+
+
+/* refills the buffer of a stream; returns 0 at the end of input */
+static int stream_fill(struct fasta_reader *fr)
+{
+long n;
+
+fr->buffer_position = 0;
+if(!fr->decompressor) { n = fread(fr->buffer, 1, STREAM_BYTES, fr->in); if(ferror(fr->in)) { fr->error=1; } }
+else if((n = decompress_read(fr->decompressor, fr->buffer, STREAM_BYTES))<0) { fr->error=1; n=0; }
+fr->buffer_end = n;
+return n>0;
+} /* end of stream_fill() */
+
+
+/* copies a stream up to the next stop character, which is left unread, or to the end of input
+   into *s, growing it as needed; with compact, whitespace and '*' are removed as it is copied.
+   Returns the length copied, after which *s is terminated with '\0' */
+static int stream_copy(struct fasta_reader *fr, int stop, int compact, char **s, int *size)
+{
+char *p;
+int n=0, chunk, found=0;
+
+while(!found && (fr->buffer_position<fr->buffer_end || stream_fill(fr)))
+     {
+     p = memchr(fr->buffer+fr->buffer_position, stop, fr->buffer_end-fr->buffer_position);
+     found = p!=NULL;
+     chunk = (found ? (size_t) (p-fr->buffer) : fr->buffer_end) - fr->buffer_position;
+     if(n+chunk+1>*size)
+       {
+       while(n+chunk+1>*size) { *size*=2; }
+       *s = realloc(*s, *size);
+       }
+     memcpy(*s+n, fr->buffer+fr->buffer_position, chunk);
+     n += compact ? (int) compact_residues(*s+n, chunk) : chunk;
+     fr->buffer_position += chunk;
+     }
+(*s)[n]='\0';
+return n;
+} /* end of stream_copy() */
+
+
+/* the next record from a stream */
+static int stream_next(struct fasta_reader *fr, struct fasta_record *record)
+{
+char *p;
+int i, n;
+
+/* skip anything before the next header */
+for(;;)
+   {
+   p = memchr(fr->buffer+fr->buffer_position, '>', fr->buffer_end-fr->buffer_position);
+   if(p) { fr->buffer_position = p-fr->buffer+1; break; }
+   if(!stream_fill(fr)) { return 0; }
+   }
+
+n = stream_copy(fr, '\n', 0, &fr->header, &fr->header_size);
+if(fr->buffer_position<fr->buffer_end) { fr->buffer_position++; }  /* the '\n' */
+for(i=0; i<n && fr->header[i]!='\r'; i++) { ; }
+if(i<n)
+  {
+  for(p=fr->header+i; i<n; i++) { if(fr->header[i]!='\r') { *p++ = fr->header[i]; } }
+  n = p-fr->header;
+  fr->header[n]='\0';
+  }
+record->header = fr->header;
+record->header_length = n;
+
+record->length = stream_copy(fr, '>', 1, &fr->sequence, &fr->sequence_size);
+record->sequence = fr->sequence;
+record->offset = -1;
+return 1;
+} /* end of stream_next() */
+
+
+/* reads the next record, returns 0 at the end of input */
+int fasta_next(struct fasta_reader *fr, struct fasta_record *record)
+{
+if(fr->in) { return stream_next(fr, record); }
+if(fr->selected)
+  {
+  if(fr->next_selected==fr->n_selected) { return 0; }
+  fr->position = fr->selected[fr->next_selected++];
+  }
+return fr->map ? map_next(fr, record) : 0;
+} /* end of fasta_next() */
+
+
+/* limits a mapped reader to the n records whose '>' are at offsets, which must be in increasing
+   order and taken from the same file (fasta_record.offset); a stream is read in full */
+void fasta_select(struct fasta_reader *fr, const long *offsets, int n)
+{
+fr->selected = offsets;
+fr->n_selected = n;
+fr->next_selected = 0;
+} /* end of fasta_select() */
+
+
+/* tells the reader that the records before the one whose header is at before are finished with;
+   a mapped reader hands their pages back once enough have built up */
+void fasta_release(struct fasta_reader *fr, const char *before)
+{
+size_t page=sysconf(_SC_PAGESIZE), upto;
+
+if(!fr->map) { return; }
+upto = (before-fr->map)/page*page;
+if(upto<fr->released+RELEASE_BYTES) { return; }
+madvise(fr->map+fr->released, upto-fr->released, MADV_DONTNEED);
+fr->released = upto;
+} /* end of fasta_release() */
+
+
+void fasta_close(struct fasta_reader *fr)
+{
+if(fr->map) { munmap(fr->map, fr->map_size); }
+if(fr->decompressor) { decompress_close(fr->decompressor); }
+if(fr->in && fr->in!=stdin) { fclose(fr->in); }
+free(fr->header);
+free(fr->sequence);
+free(fr->buffer);
+free(fr);
+} /* end of fasta_close() */
+
+/******** END OF CODE FILE ********/
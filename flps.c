@@ -0,0 +1,439 @@
+/****
+ **** flps.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  fLPS-style scanning for single-residue compositional biases, with the parameters
+ ****  m, M and t chosen by fLPSparameters.
+ ****
+ ****  Every window of every size w from m to M is tested for each residue: the window is biased
+ ****  for a residue if the binomial probability of at least its count of that residue, given the
+ ****  residue's background frequency, is <= t. Biased windows for the same residue that overlap
+ ****  are merged into one region, reported with the lowest P-value among its windows.
+ ****  Unlike the fLPS program, multiple-residue biases are not searched for.
+ ****
+ ****  Several parameter sets can be scanned for in one pass. The log10 binomial tail probabilities
+ ****  for every window size and count are tabulated once, over the range of window sizes of all
+ ****  the sets, so the scan itself only looks them up. Since a tail falls as the count rises,
+ ****  each set's threshold t becomes the least count of each residue that is biased in each
+ ****  window size, so whether a window is biased is one integer comparison, and a P-value is
+ ****  looked up only for the windows that are. The least counts are worked out from the tails in
+ ****  double; the table the P-values are reported from holds floats, one cache-line-aligned row
+ ****  per window size, half the size of doubles. At each start position the window grows
+ ****  one residue at a time from the smallest size to the largest, so the counts are shared by
+ ****  all window sizes and all sets, and only the residue just added needs testing: a residue
+ ****  whose count did not change cannot become more significant in a longer window. How much
+ ****  longer its window can grow and stay biased is tabulated per count for each set. In each
+ ****  set's smallest window, the residues already biased are carried over from the previous
+ ****  start position, and only the residues leaving and entering it are tested again.
+ ****
+ ****  The counts come from a prefix-count index of the sequence (count_prefixes()), built once
+ ****  per sequence, in which the count of a residue in any window is the difference of two
+ ****  entries, so nothing is carried from one start position or window size to the next. The
+ ****  entries are 16-bit, 40 bytes per position, so that the rows a start position reads, from
+ ****  it to M residues on, stay in cache; a difference of two is exact for any window shorter
+ ****  than 65536, and 32-bit checkpoints every 65536 positions give the counts of longer
+ ****  stretches.
+ ****
+ ****  Most windows of a proteome are not biased, and most start positions need not be tried at
+ ****  all. The window sizes are split into FLPS_BANDS bands, each with the least count of each
+ ****  residue biased in any of its windows with any set. No window in a band that starts in a
+ ****  stretch of positions can hold more of a residue than the stretch it spans does, so if no
+ ****  residue's count there reaches the band's least count, in any band, none of the windows
+ ****  is biased. The scan tests FLPS_STRETCH start positions at once this way, then single ones
+ ****  where the stretch may be biased, and skips those that cannot be, from the prefix counts
+ ****  alone, without a P-value.
+ ****
+ ****  Reference:
+ ****    Harrison, PM. 'fLPS: fast discovery of compositional biases for the protein universe',
+ ****    (2017) BMC Bioinformatics, 18: 476.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "scan.h"
+
+/* UniProtKB/Swiss-Prot amino acid composition, in the order of amino_acids[] */
+const double background_frequencies[NUMBER_OF_RESIDUES] = {
+  0.0825, 0.0137, 0.0545, 0.0675, 0.0386, 0.0707, 0.0227, 0.0596, 0.0584, 0.0966,
+  0.0242, 0.0406, 0.0470, 0.0393, 0.0553, 0.0656, 0.0534, 0.0687, 0.0108, 0.0292 };
+
+
+/*  *  *  * PREFIX COUNTS *  *  *  */
+
+/* fills pc with the counts of each residue before every position of the sequence */
+void count_prefixes(struct prefix_counts *pc, const unsigned char *codes, int length)
+{
+uint32_t total[NUMBER_OF_RESIDUES+1]={0};
+uint16_t low[NUMBER_OF_RESIDUES+1]={0};
+int i, n_checkpoints=(length>>PREFIX_BLOCK_BITS)+1;
+
+if(length+1>pc->size)
+  {
+  pc->size = length+1;
+  pc->low = realloc(pc->low, pc->size*sizeof(*pc->low));
+  }
+if(n_checkpoints>pc->n_checkpoints)
+  {
+  pc->n_checkpoints = n_checkpoints;
+  pc->checkpoint = realloc(pc->checkpoint, pc->n_checkpoints*sizeof(*pc->checkpoint));
+  }
+for(i=0; i<=length; i++)
+   {
+   if(!(i & ((1<<PREFIX_BLOCK_BITS)-1))) { memcpy(pc->checkpoint[i>>PREFIX_BLOCK_BITS], total, sizeof(*pc->checkpoint)); }
+   memcpy(pc->low[i], low, sizeof(*pc->low));
+   if(i<length) { total[codes[i]]++; low[codes[i]]++; }
+   }
+} /* end of count_prefixes() */
+
+
+void free_prefixes(struct prefix_counts *pc)
+{
+free(pc->low);
+free(pc->checkpoint);
+memset(pc, 0, sizeof(*pc));
+} /* end of free_prefixes() */
+
+
+/*  *  *  * SCANNING *  *  *  */
+
+/* fills tail[k] = log10 P(X>=k) for X ~ binomial(w, f), k = 0..w */
+static void log_binomial_tail(int w, double f, const double *log_factorial, double *tail)
+{
+int k;
+double log_f=log(f), log_g=log1p(-f), term, sum=-INFINITY;
+
+for(k=w; k>=0; k--)
+   {
+   term = log_factorial[w] - log_factorial[k] - log_factorial[w-k] + k*log_f + (w-k)*log_g;
+   sum = sum>term ? sum + log1p(exp(term-sum)) : term + log1p(exp(sum-term));
+   tail[k] = sum/M_LN10;
+   }
+tail[0] = 0.0;
+} /* end of log_binomial_tail() */
+
+
+/* a scanner for the n_sets sets, from 1 to MAX_PARAMETER_SETS; returns NULL unless every set has
+   1 <= m <= M */
+struct flps_scanner *flps_create(int n_sets, const struct flps_set *sets, const double *background)
+{
+struct flps_scanner *flps;
+double *log_factorial, *tail;
+unsigned short *least;
+int r, s, w, n, k, b, n_windows;
+
+if(n_sets<1 || n_sets>MAX_PARAMETER_SETS) { return NULL; }
+for(s=0; s<n_sets; s++) { if(sets[s].small_m<1 || sets[s].small_m>sets[s].big_m) { return NULL; } }
+flps = calloc(1, sizeof(struct flps_scanner));
+flps->n_sets = n_sets;
+flps->small_m = sets[0].small_m;
+flps->big_m = sets[0].big_m;
+for(s=0; s<n_sets; s++)
+   {
+   flps->sets[s] = sets[s];
+   if(sets[s].small_m<flps->small_m) { flps->small_m = sets[s].small_m; }
+   if(sets[s].big_m>flps->big_m) { flps->big_m = sets[s].big_m; }
+   }
+n_windows = flps->n_windows = flps->big_m-flps->small_m+1;
+flps->stride = (flps->big_m+CACHE_LINE_FLOATS)/CACHE_LINE_FLOATS*CACHE_LINE_FLOATS;
+
+/* per window size, the sets for which it is the smallest window and the sets for which it is a
+   longer one, so the scan can skip most of them */
+flps->starting = calloc(n_windows, sizeof(unsigned int));
+flps->growing = calloc(n_windows, sizeof(unsigned int));
+for(s=0; s<n_sets; s++)
+   {
+   flps->starting[sets[s].small_m-flps->small_m] |= 1u<<s;
+   for(w=sets[s].small_m+1; w<=sets[s].big_m; w++) { flps->growing[w-flps->small_m] |= 1u<<s; }
+   }
+
+/* the tails are worked out in double, and the least counts and reaches, which decide what is
+   biased, from them; only the P-values reported are taken from the float table */
+log_factorial = malloc((flps->big_m+1)*sizeof(double));
+for(n=0; n<=flps->big_m; n++) { log_factorial[n] = lgamma(n+1.0); }
+tail = malloc((flps->big_m+1)*sizeof(double));
+for(s=0; s<n_sets; s++)
+   {
+   flps->least[s] = malloc(NUMBER_OF_RESIDUES*n_windows*sizeof(unsigned short));
+   for(n=0; n<NUMBER_OF_RESIDUES*n_windows; n++) { flps->least[s][n] = flps->big_m+1; }
+   flps->reach[s] = calloc(NUMBER_OF_RESIDUES*flps->stride, sizeof(short));
+   }
+flps->least_growing = malloc(NUMBER_OF_RESIDUES*n_windows*sizeof(unsigned short));
+for(n=0; n<NUMBER_OF_RESIDUES*n_windows; n++) { flps->least_growing[n] = flps->big_m+1; }
+
+for(r=0; r<NUMBER_OF_RESIDUES; r++)
+   {
+   flps->log_tail[r] = aligned_alloc(CACHE_LINE_FLOATS*sizeof(float), (size_t) n_windows*flps->stride*sizeof(float));
+   for(w=flps->small_m; w<=flps->big_m; w++)
+      {
+      log_binomial_tail(w, background[r], log_factorial, tail);
+      for(k=0; k<=w; k++) { flps->log_tail[r][(w-flps->small_m)*flps->stride+k] = tail[k]; }
+      for(s=0; s<n_sets; s++)
+         {
+         if(w<sets[s].small_m || w>sets[s].big_m) { continue; }
+         least = &flps->least[s][r*n_windows+w-flps->small_m];
+         for(k=w; k>0 && tail[k]<=sets[s].threshold; k--) { *least = k; }
+         if(w>sets[s].small_m && *least<flps->least_growing[r*n_windows+w-flps->small_m])
+           { flps->least_growing[r*n_windows+w-flps->small_m] = *least; }
+         }
+      }
+   }
+free(tail);
+free(log_factorial);
+
+/* bands of window sizes, with the least count of each residue biased in any window of any set
+   in the band, for skipping stretches of start positions */
+flps->n_bands = n_windows<FLPS_BANDS ? n_windows : FLPS_BANDS;
+for(b=0; b<flps->n_bands; b++)
+   {
+   flps->band_end[b] = flps->small_m+(b+1)*n_windows/flps->n_bands-1;
+   for(r=0; r<NUMBER_OF_RESIDUES; r++) { flps->band_least[b][r] = flps->big_m+1; }
+   }
+for(s=0; s<n_sets; s++)
+   for(w=sets[s].small_m, b=0; w<=sets[s].big_m; w++)
+      {
+      while(flps->band_end[b]<w) { b++; }
+      for(r=0; r<NUMBER_OF_RESIDUES; r++)
+         {
+         if(flps->least[s][r*n_windows+w-flps->small_m]<flps->band_least[b][r])
+           { flps->band_least[b][r] = flps->least[s][r*n_windows+w-flps->small_m]; }
+         }
+      }
+
+/* reach[s][r*stride+k]: the longest window of set s in which a count of k of residue r is still biased */
+for(s=0; s<n_sets; s++)
+   for(r=0; r<NUMBER_OF_RESIDUES; r++)
+      for(n=1; n<=sets[s].big_m; n++)
+         for(w=sets[s].big_m; w>=sets[s].small_m && w>=n; w--)
+            {
+            if(n>=flps->least[s][r*n_windows+w-flps->small_m])
+              { flps->reach[s][r*flps->stride+n] = w; break; }
+            }
+return flps;
+} /* end of flps_create() */
+
+
+/* adds the biased windows [start, end) of one start position to the set's growing region for the residue */
+static void extend_region(struct flps_scanner *flps, int s, int r, int start, int end, double p,
+                          struct region_list *regions)
+{
+struct region *open = &flps->open[s][r];
+
+if(open->start>=0 && start<open->end)
+  {
+  if(end>open->end) { open->end = end; }
+  if(p<open->score) { open->score = p; }
+  return;
+  }
+if(open->start>=0) { add_region(&regions[s], open->start, open->end, r, open->score); }
+open->start = start;
+open->end = end;
+open->score = p;
+} /* end of extend_region() */
+
+
+/* tests the residues in the set's smallest window starting at i, updating flps->biased[s]:
+   all residues if all is set, otherwise just the ones leaving and entering the window since
+   the start position before */
+static void test_smallest_window(struct flps_scanner *flps, int s, const unsigned char *codes, int i, int all)
+{
+const unsigned short *least=flps->least[s]+flps->sets[s].small_m-flps->small_m;
+int j, r, residues[2], end=i+flps->sets[s].small_m;
+
+if(all)
+  {
+  flps->biased[s]=0;
+  for(r=0; r<NUMBER_OF_RESIDUES; r++)
+     { if(window_count(&flps->prefix, r, i, end)>=least[r*flps->n_windows]) { flps->biased[s] |= 1u<<r; } }
+  return;
+  }
+residues[0] = codes[i-1];
+residues[1] = codes[end-1];
+for(j=0; j<2; j++)
+   {
+   r = residues[j];
+   if(r==OTHER_RESIDUE) { continue; }
+   if(window_count(&flps->prefix, r, i, end)>=least[r*flps->n_windows]) { flps->biased[s] |= 1u<<r; }
+   else { flps->biased[s] &= ~(1u<<r); }
+   }
+} /* end of test_smallest_window() */
+
+
+/* whether any set can have a biased window starting from start to start+n_starts-1: for some
+   band of window sizes, the count of a residue in the stretch that such windows span reaches
+   the least count of the band. The stretches are far shorter than 1<<PREFIX_BLOCK_BITS */
+static int may_be_biased(const struct flps_scanner *flps, int start, int n_starts, int length)
+{
+const uint16_t *from=flps->prefix.low[start], *to;
+int b, r, end, reached=0;
+
+for(b=0; b<flps->n_bands && !reached; b++)
+   {
+   end = start+n_starts-1+flps->band_end[b];
+   to = flps->prefix.low[end<length ? end : length];
+   for(r=0; r<NUMBER_OF_RESIDUES; r++) { reached |= (uint16_t) (to[r]-from[r])>=flps->band_least[b][r]; }
+   }
+return reached;
+} /* end of may_be_biased() */
+
+
+/* scans for all the sets at once; regions[s] receives the regions found with set s */
+void flps_scan(struct flps_scanner *flps, const unsigned char *codes, int length, struct region_list *regions)
+{
+const struct prefix_counts *pc=&flps->prefix;
+int longest[MAX_PARAMETER_SETS][NUMBER_OF_RESIDUES];
+double best[MAX_PARAMETER_SETS][NUMBER_OF_RESIDUES], p;
+unsigned int found[MAX_PARAMETER_SETS], bits, mask;
+int i, r, s, k, n, w, row, last_w, stride=flps->stride, n_windows=flps->n_windows, stretch_end, all;
+int small_m=flps->small_m, n_sets=flps->n_sets;
+
+for(s=0; s<n_sets; s++)
+   {
+   regions[s].n=0;
+   for(r=0; r<NUMBER_OF_RESIDUES; r++) { flps->open[s][r].start=-1; }
+   }
+count_prefixes(&flps->prefix, codes, length);
+
+for(i=0, stretch_end=0, all=1; i+small_m<=length; i++)
+   {
+   /* skip the start positions that cannot have a biased window, a stretch at a time where the
+      stretch as a whole cannot, then the smallest windows must be tested afresh */
+   if(i>=stretch_end)
+     {
+     if(!may_be_biased(flps, i, FLPS_STRETCH, length)) { i += FLPS_STRETCH-1; all = 1; continue; }
+     stretch_end = i+FLPS_STRETCH;
+     }
+   if(!may_be_biased(flps, i, 1, length)) { all = 1; continue; }
+   last_w = length-i < flps->big_m ? length-i : flps->big_m;
+
+   /* each set's smallest window */
+   for(s=0; s<n_sets; s++)
+      {
+      found[s] = 0;
+      if((w = flps->sets[s].small_m)>last_w) { continue; }
+      row = (w-small_m)*stride;
+      test_smallest_window(flps, s, codes, i, all);
+      for(mask=flps->biased[s]; mask; mask&=mask-1)
+         {
+         k = __builtin_ctz(mask);
+         n = window_count(pc, k, i, i+w);
+         longest[s][k] = flps->reach[s][k*stride+n];
+         best[s][k] = flps->log_tail[k][row+n];
+         }
+      found[s] = flps->biased[s];
+      }
+   all = 0;
+
+   /* the longer windows, testing just the residue added to each, which most often falls short
+      of the least count any set needs at once */
+   for(w=small_m+1; w<=last_w; w++)
+      {
+      r = codes[i+w-1];
+      if(r==OTHER_RESIDUE) { continue; }
+      n = window_count(pc, r, i, i+w);
+      if(n<flps->least_growing[r*n_windows+w-small_m]) { continue; }
+      p = flps->log_tail[r][(w-small_m)*stride+n];
+      for(bits=flps->growing[w-small_m]; bits; bits&=bits-1)
+         {
+         s = __builtin_ctz(bits);
+         if(n<flps->least[s][r*n_windows+w-small_m]) { continue; }
+         k = flps->reach[s][r*stride+n];
+         if(!(found[s] & 1u<<r) || k>longest[s][r]) { longest[s][r] = k; }
+         if(!(found[s] & 1u<<r) || p<best[s][r]) { best[s][r] = p; }
+         found[s] |= 1u<<r;
+         } /* end of for each set */
+      } /* end of for each window size */
+
+   for(s=0; s<n_sets; s++)
+      for(bits=found[s]; bits; bits&=bits-1)
+         {
+         r = __builtin_ctz(bits);
+         w = longest[s][r]<last_w ? longest[s][r] : last_w;
+         extend_region(flps, s, r, i, i+w, best[s][r], regions);
+         }
+   } /* end of for each start position */
+
+for(s=0; s<n_sets; s++)
+   {
+   for(r=0; r<NUMBER_OF_RESIDUES; r++)
+      {
+      if(flps->open[s][r].start>=0)
+        { add_region(&regions[s], flps->open[s][r].start, flps->open[s][r].end, r, flps->open[s][r].score); }
+      }
+   sort_regions(&regions[s]);
+   }
+} /* end of flps_scan() */
+
+
+/* a scanner for another thread, sharing the tables of flps, which must outlive it */
+struct flps_scanner *flps_clone(const struct flps_scanner *flps)
+{
+struct flps_scanner *clone;
+
+clone = malloc(sizeof(struct flps_scanner));
+memcpy(clone, flps, sizeof(struct flps_scanner));
+clone->shared = 1;
+memset(&clone->prefix, 0, sizeof(clone->prefix));
+return clone;
+} /* end of flps_clone() */
+
+
+void flps_free(struct flps_scanner *flps)
+{
+int r, s;
+
+free_prefixes(&flps->prefix);
+if(flps->shared) { free(flps); return; }
+for(r=0; r<NUMBER_OF_RESIDUES; r++) { free(flps->log_tail[r]); }
+for(s=0; s<flps->n_sets; s++) { free(flps->reach[s]); free(flps->least[s]); }
+free(flps->least_growing);
+free(flps->starting);
+free(flps->growing);
+free(flps);
+} /* end of flps_free() */
+
+
+/*  *  *  * SELF-CHECK *  *  *  */
+
+/* returns the number of windows and stretches of a random sequence, mostly of one residue so
+   that its count needs the checkpoints, in which a residue's count from the prefix counts
+   differs from one by counting */
+int check_prefixes(void)
+{
+struct prefix_counts pc={0};
+unsigned char *codes;
+unsigned long long state=88172645463325252ULL;
+int length=3<<PREFIX_BLOCK_BITS, i, k, r, start, end, n, errors=0;
+
+codes = malloc(length);
+for(i=0; i<length; i++)
+   {
+   state ^= state<<13; state ^= state>>7; state ^= state<<17;
+   codes[i] = (i>>10)%4==3 ? state%(NUMBER_OF_RESIDUES+1) : 0;
+   }
+count_prefixes(&pc, codes, length);
+for(k=0; k<2200; k++)
+   {
+   state ^= state<<13; state ^= state>>7; state ^= state<<17;
+   r = state%NUMBER_OF_RESIDUES;
+   start = (state>>8)%length;
+   end = k<2000 ? start+(state>>40)%500 : start+(state>>40)%(length-start);
+   if(end>length) { end = length; }
+   for(i=start, n=0; i<end; i++) { n += codes[i]==r; }
+   if(k<2000 && window_count(&pc, r, start, end)!=n) { errors++; }
+   if(stretch_count(&pc, r, start, end)!=n) { errors++; }
+   }
+free_prefixes(&pc);
+free(codes);
+return errors;
+} /* end of check_prefixes() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,191 @@
+/****
+ **** format.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Machine-readable output of parameter sets, one row per set:
+ ****
+ ****   tsv     tool, focus, coverage, target length, the three parameters and the reason code,
+ ****           tab-separated without a header. Parameters are 'NA' for sets that are not valid.
+ ****   json    one JSON object per line (NDJSON), with null parameters for sets that are not valid.
+ ****   binary  packed records of PARAMETER_RECORD_SIZE bytes, all fields little-endian:
+ ****             0  double  K1
+ ****             8  double  K2
+ ****            16  double  threshold (log10 P)
+ ****            24  int16   target_length
+ ****            26  int16   L
+ ****            28  int16   small_m
+ ****            30  int16   big_m
+ ****            32  uint8   tool (0 = SEG, 1 = fLPS)
+ ****            33  uint8   focus (0 = DIVERSE, 1 = NARROW)
+ ****            34  uint8   coverage (percent)
+ ****            35  uint8   reason (REASON_ flags in parameters.h, 0 if valid)
+ ****            36  int16   upper_bound
+ ****            38  int16   lower_bound (a uint8 and a reserved 0 before, which read the same
+ ****                        for lower bounds up to 255)
+ ****           The doubles are stored at full precision; the text formats round them as
+ ****           the programs' own output does.
+ ****
+ ****  With -r, the tsv and json rows go on with the expected distribution of region lengths
+ ****  (write_parameters_lengths()); binary records are the same either way.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "parameters.h"
+
+int parse_output_format(const char *s)
+{
+if(!strcmp(s, "text")) { return TEXT_FORMAT; }
+if(!strcmp(s, "tsv")) { return TSV_FORMAT; }
+if(!strcmp(s, "json")) { return JSON_FORMAT; }
+if(!strcmp(s, "binary")) { return BINARY_FORMAT; }
+return -1;
+} /* end of parse_output_format() */
+
+
+static void put_double(unsigned char *p, double x)
+{
+uint64_t u;
+int i;
+
+memcpy(&u, &x, 8);
+for(i=0; i<8; i++) { p[i] = u>>(8*i); }
+} /* end of put_double() */
+
+static double get_double(const unsigned char *p)
+{
+uint64_t u=0;
+double x;
+int i;
+
+for(i=0; i<8; i++) { u |= (uint64_t) p[i]<<(8*i); }
+memcpy(&x, &u, 8);
+return x;
+} /* end of get_double() */
+
+static void put_int16(unsigned char *p, int x) { p[0]=x; p[1]=x>>8; }
+static int get_int16(const unsigned char *p) { return (int16_t) (p[0] | p[1]<<8); }
+
+
+void pack_parameter_record(const struct parameter_set *ps, unsigned char *record)
+{
+put_double(record, ps->K1);
+put_double(record+8, ps->K2);
+put_double(record+16, ps->threshold);
+put_int16(record+24, ps->target_length);
+put_int16(record+26, ps->L);
+put_int16(record+28, ps->small_m);
+put_int16(record+30, ps->big_m);
+record[32]=ps->tool;
+record[33]=ps->focus;
+record[34]=ps->coverage;
+record[35]=ps->reason;
+put_int16(record+36, ps->upper_bound);
+put_int16(record+38, ps->lower_bound);
+} /* end of pack_parameter_record() */
+
+
+void unpack_parameter_record(const unsigned char *record, struct parameter_set *ps)
+{
+memset(ps, 0, sizeof(*ps));
+ps->K1 = get_double(record);
+ps->K2 = get_double(record+8);
+ps->threshold = get_double(record+16);
+ps->target_length = get_int16(record+24);
+ps->L = get_int16(record+26);
+ps->small_m = get_int16(record+28);
+ps->big_m = get_int16(record+30);
+ps->tool = record[32];
+ps->focus = record[33];
+ps->coverage = record[34];
+ps->reason = record[35];
+ps->not_valid = ps->reason!=0;
+ps->upper_bound = get_int16(record+36);
+ps->lower_bound = get_int16(record+38);
+} /* end of unpack_parameter_record() */
+
+
+/* the region lengths after the parameters of a text row, if d is not NULL */
+static void write_lengths(FILE *out, const struct length_distribution *d, enum output_format format)
+{
+int bin;
+
+if(!d) { return; }
+if(format==TSV_FORMAT)
+  {
+  if(d->known>=LENGTHS_MEAN) { fprintf(out, "\t%.1lf", d->mean); } else { fprintf(out, "\tNA"); }
+  if(d->known<LENGTHS_FULL) { fprintf(out, "\tNA\tNA"); return; }
+  fprintf(out, "\t%.1lf\t", d->variance);
+  for(bin=0; bin<LENGTH_BINS; bin++) { fprintf(out, "%s%.3lf", bin ? "," : "", d->histogram[bin]); }
+  return;
+  }
+if(d->known>=LENGTHS_MEAN) { fprintf(out, ",\"mean_length\":%.1lf", d->mean); }
+else { fprintf(out, ",\"mean_length\":null"); }
+if(d->known<LENGTHS_FULL) { fprintf(out, ",\"length_variance\":null,\"length_histogram\":null"); return; }
+fprintf(out, ",\"length_variance\":%.1lf,\"length_histogram\":[", d->variance);
+for(bin=0; bin<LENGTH_BINS; bin++) { fprintf(out, "%s%.3lf", bin ? "," : "", d->histogram[bin]); }
+fprintf(out, "]");
+} /* end of write_lengths() */
+
+
+/* a row of output, followed in tsv and json by the distribution of region lengths d if it is not
+   NULL (lengths.c): in tsv, the mean, the variance and the histogram as comma-separated
+   proportions, 'NA' where not known; in json, mean_length, length_variance and length_histogram,
+   null where not known. Binary records have no room for them */
+void write_parameters_lengths(FILE *out, const struct parameter_set *ps, const struct length_distribution *d,
+                              enum output_format format)
+{
+unsigned char record[PARAMETER_RECORD_SIZE];
+
+switch(format) {
+  case TSV_FORMAT:
+    fprintf(out, "%s\t%s\t%d\t%d\t", tool_name[ps->tool], focus_name[ps->focus], ps->coverage, ps->target_length);
+    if(ps->not_valid) { fprintf(out, "NA\tNA\tNA\t%d", ps->reason); }
+    else if(ps->tool==SEG) { fprintf(out, "%d\t%.2lf\t%.2lf\t0", ps->L, ps->K1, ps->K2); }
+    else { fprintf(out, "%d\t%d\t%.1le\t0", ps->small_m, ps->big_m, pow(10.0, ps->threshold)); }
+    write_lengths(out, d, format);
+    fprintf(out, "\n");
+    break;
+
+  case JSON_FORMAT:
+    fprintf(out, "{\"tool\":\"%s\",\"focus\":\"%s\",\"coverage\":%d,\"target_length\":%d,",
+            tool_name[ps->tool], focus_name[ps->focus], ps->coverage, ps->target_length);
+    if(ps->tool==SEG)
+      {
+      if(ps->not_valid) { fprintf(out, "\"L\":null,\"K1\":null,\"K2\":null,"); }
+      else { fprintf(out, "\"L\":%d,\"K1\":%.2lf,\"K2\":%.2lf,", ps->L, ps->K1, ps->K2); }
+      }
+    else {
+         if(ps->not_valid) { fprintf(out, "\"m\":null,\"M\":null,\"t\":null,"); }
+         else { fprintf(out, "\"m\":%d,\"M\":%d,\"t\":%.1le,", ps->small_m, ps->big_m, pow(10.0, ps->threshold)); }
+         }
+    fprintf(out, "\"valid\":%s,\"reason\":%d", ps->not_valid ? "false" : "true", ps->reason);
+    write_lengths(out, d, format);
+    fprintf(out, "}\n");
+    break;
+
+  case BINARY_FORMAT:
+    pack_parameter_record(ps, record);
+    fwrite(record, 1, PARAMETER_RECORD_SIZE, out);
+    break;
+
+  default: break; /* TEXT_FORMAT is laid out by the programs themselves */
+} /* end of switch */
+} /* end of write_parameters_lengths() */
+
+
+void write_parameters(FILE *out, const struct parameter_set *ps, enum output_format format)
+{
+write_parameters_lengths(out, ps, NULL, format);
+} /* end of write_parameters() */
+
+/******** END OF CODE FILE ********/
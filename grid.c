@@ -0,0 +1,184 @@
+/****
+ **** grid.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Evaluation of the model curves over many target lengths at once, for dense grids of
+ ****  parameters (evaluate_grid() in parameters.c). The curves are computed several lengths at
+ ****  a time with SSE2, AVX2 or AVX-512 vectors, whichever is the widest the processor has,
+ ****  chosen when the program runs; the kernel is the same code for each (grid_kernel.inc).
+ ****
+ ****  The vector log() and exp() are not the C library's, and can differ from it in the last
+ ****  place, so check_grid() confirms that a grid evaluated with them always gives the same
+ ****  L, m, M and validity as evaluate_model(). 'make' runs it through selfcheck.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "parameters.h"
+
+const char grid_isa_name[4][8] = {"scalar", "sse2", "avx2", "avx512"};
+
+static void scalar_curve_values(const struct model_curve *curve, const double *x, const double *base,
+                                int n, double *values)
+{
+int i;
+
+for(i=0; i<n; i++) { values[i] = curve_value(curve, x[i], base ? base[i] : 0.0); }
+} /* end of scalar_curve_values() */
+
+
+#if defined(__x86_64__)
+
+/* fdlibm's constants for log() and exp() */
+#define SQRT2   1.41421356237309504880
+#define LN2_HI  6.93147180369123816490e-01
+#define LN2_LO  1.90821492927058770002e-10
+#define INV_LN2 1.44269504088896338700e+00
+#define LG1 6.666666666666735130e-01
+#define LG2 3.999999999940941908e-01
+#define LG3 2.857142874366239149e-01
+#define LG4 2.222219843214978396e-01
+#define LG5 1.818357216161805012e-01
+#define LG6 1.531383769920937332e-01
+#define LG7 1.479819860511658591e-01
+#define P1  1.66666666666666019037e-01
+#define P2 -2.77777777770155933842e-03
+#define P3  6.61375632143793436117e-05
+#define P4 -1.65339022054652515390e-06
+#define P5  4.13813679705723846039e-08
+
+#define WIDTH 2
+#define KERNEL(name) name##_sse2
+#include "grid_kernel.inc"
+#undef WIDTH
+#undef KERNEL
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define WIDTH 4
+#define KERNEL(name) name##_avx2
+#include "grid_kernel.inc"
+#undef WIDTH
+#undef KERNEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define WIDTH 8
+#define KERNEL(name) name##_avx512
+#include "grid_kernel.inc"
+#undef WIDTH
+#undef KERNEL
+#pragma GCC pop_options
+
+#endif
+
+
+int grid_isa_supported(enum grid_isa isa)
+{
+#if defined(__x86_64__)
+__builtin_cpu_init();
+switch(isa) {
+  case GRID_SCALAR: return 1;
+  case GRID_SSE2:   return 1;
+  case GRID_AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case GRID_AVX512: return __builtin_cpu_supports("avx512f");
+  default:          return 0;
+} /* end of switch */
+#else
+return isa==GRID_SCALAR;
+#endif
+} /* end of grid_isa_supported() */
+
+
+enum grid_isa best_grid_isa(void)
+{
+int isa;
+
+for(isa=GRID_AVX512; isa>GRID_SCALAR && !grid_isa_supported(isa); isa--) { ; }
+return isa;
+} /* end of best_grid_isa() */
+
+
+/* values[i] = curve_value(curve, x[i], base[i]), with base taken as 0 if it is NULL, using the
+   vector instructions isa, which must be supported */
+void curve_values(enum grid_isa isa, const struct model_curve *curve, const double *x, const double *base,
+                  int n, double *values)
+{
+switch(isa) {
+#if defined(__x86_64__)
+  case GRID_SSE2:   curve_values_sse2(curve, x, base, n, values); break;
+  case GRID_AVX2:   curve_values_avx2(curve, x, base, n, values); break;
+  case GRID_AVX512: curve_values_avx512(curve, x, base, n, values); break;
+#endif
+  default:          scalar_curve_values(curve, x, base, n, values); break;
+} /* end of switch */
+} /* end of curve_values() */
+
+
+/*  *  *  * SELF-CHECK *  *  *  */
+
+/* returns the number of grid points, over every model and every whole coverage from 2 to 40, at
+   which a grid evaluated with isa differs from evaluate_model() in L, m, M or validity, or in any
+   other parameter by more than a relative 1e-12. The grid is every target length from 1 to
+   1000, which evaluate_model() takes, then every twentieth from 1 to 400 against the scalar grid */
+int check_grid(enum grid_isa isa)
+{
+struct parameter_set *sets, *reference, ps;
+double *lengths;
+int tool, focus, coverage, i, n, errors=0;
+
+n = 7981;
+lengths = malloc(n*sizeof(double));
+sets = malloc(n*sizeof(struct parameter_set));
+reference = malloc(n*sizeof(struct parameter_set));
+for(tool=SEG; tool<=FLPS; tool++)
+   for(focus=DIVERSE; focus<=NARROW; focus++)
+      for(coverage=MIN_COVERAGE; coverage<=MAX_COVERAGE; coverage++)
+         {
+         for(i=0; i<1000; i++) { lengths[i] = i+1; }
+         evaluate_grid_isa(isa, &builtin_models, tool, focus, coverage, lengths, 1000, sets);
+         for(i=0; i<1000; i++)
+            {
+            ps = evaluate_model(&builtin_models, tool, focus, i+1, coverage);
+            if(ps.L!=sets[i].L || ps.small_m!=sets[i].small_m || ps.big_m!=sets[i].big_m || ps.reason!=sets[i].reason
+               || fabs(ps.K1-sets[i].K1)>1e-12*fabs(ps.K1) || fabs(ps.K2-sets[i].K2)>1e-12*fabs(ps.K2)
+               || fabs(ps.threshold-sets[i].threshold)>1e-12*fabs(ps.threshold))
+              {
+              if(errors<10)
+                { fprintf(stderr, "grid mismatch (%s): %s %s %d%% target length %d\n", grid_isa_name[isa],
+                          tool_name[tool], focus_name[focus], coverage, i+1); }
+              errors++;
+              }
+            }
+
+         for(i=0; i<n; i++) { lengths[i] = 1.0+i/20.0; }
+         evaluate_grid_isa(isa, &builtin_models, tool, focus, coverage, lengths, n, sets);
+         evaluate_grid_isa(GRID_SCALAR, &builtin_models, tool, focus, coverage, lengths, n, reference);
+         for(i=0; i<n; i++)
+            {
+            if(reference[i].L!=sets[i].L || reference[i].small_m!=sets[i].small_m || reference[i].big_m!=sets[i].big_m
+               || reference[i].reason!=sets[i].reason || fabs(reference[i].K1-sets[i].K1)>1e-12*fabs(reference[i].K1)
+               || fabs(reference[i].K2-sets[i].K2)>1e-12*fabs(reference[i].K2)
+               || fabs(reference[i].threshold-sets[i].threshold)>1e-12*fabs(reference[i].threshold))
+              {
+              if(errors<10)
+                { fprintf(stderr, "grid mismatch (%s): %s %s %d%% target length %.2f\n", grid_isa_name[isa],
+                          tool_name[tool], focus_name[focus], coverage, lengths[i]); }
+              errors++;
+              }
+            }
+         } /* end of for each model and coverage */
+free(lengths);
+free(sets);
+free(reference);
+return errors;
+} /* end of check_grid() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,122 @@
+/****
+ **** lengths.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  The expected distribution of the lengths of the regions that a parameter set finds: their
+ ****  mean and variance, and a histogram of them, so that output and later work on the regions
+ ****  (alignment, clustering) can be sized before a scan is run.
+ ****
+ ****  Each model has two more curves of the target length, for the mean and the standard
+ ****  deviation of the region lengths, which calibration fits along with the parameters
+ ****  (calibrate.c). The histogram is that of a log-normal distribution with the same mean and
+ ****  variance, over bins that double in width:
+ ****
+ ****    1-9  10-19  20-39  40-79  80-159  160-319  320-639  640-
+ ****
+ ****  Coverages between the fitted levels are interpolated across the levels as the parameters
+ ****  are (parameters.c). The built-in models have no length curves, since they were fitted to
+ ****  the target lengths alone, so only a calibrated model (-C) predicts the region lengths.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "parameters.h"
+
+const int length_bin_start[LENGTH_BINS] = {1, 10, 20, 40, 80, 160, 320, 640};
+
+int length_bin(int length)
+{
+int bin;
+
+for(bin=LENGTH_BINS-1; bin>0 && length<length_bin_start[bin]; bin--) { ; }
+return bin;
+} /* end of length_bin() */
+
+
+/* the proportions of a log-normal distribution with the given mean and variance in each bin,
+   each taken as the whole lengths from its start to the next bin's, less half a residue */
+void lognormal_histogram(double mean, double variance, double *histogram)
+{
+double sigma, mu, below=0.0, cumulative;
+int bin;
+
+sigma = sqrt(log(1.0 + variance/(mean*mean)));
+mu = log(mean) - sigma*sigma/2.0;
+for(bin=0; bin<LENGTH_BINS; bin++)
+   {
+   if(bin==LENGTH_BINS-1) { cumulative = 1.0; }
+   else if(sigma>0.0) { cumulative = 0.5*erfc(-(log(length_bin_start[bin+1]-0.5) - mu)/(sigma*M_SQRT2)); }
+   else { cumulative = mean<length_bin_start[bin+1]-0.5 ? 1.0 : 0.0; }
+   histogram[bin] = cumulative-below;
+   below = cumulative;
+   }
+} /* end of lognormal_histogram() */
+
+
+/* the value of a length curve of each model of the tool and focus at x; returns 0 if any has not
+   been fitted */
+static int level_values(const struct parameter_models *models, const struct parameter_set *ps, int sd, double x,
+                        double *values)
+{
+const struct model_curve *curve;
+int i;
+
+for(i=0; i<NUMBER_OF_COVERAGES; i++)
+   {
+   curve = sd ? &models->model[ps->tool][ps->focus][i].length_sd : &models->model[ps->tool][ps->focus][i].length_mean;
+   if(curve->below.form==NO_CURVE) { return 0; }
+   values[i] = curve_value(curve, x, 0.0);
+   }
+return 1;
+} /* end of level_values() */
+
+
+/* the length curve of the set's model at its target length, interpolated across the levels if
+   its coverage is between them; returns 0 if it has not been fitted */
+static int length_value(const struct parameter_models *models, const struct parameter_set *ps, int sd, double *value)
+{
+const struct model_curve *curve;
+double levels[NUMBER_OF_COVERAGES], values[NUMBER_OF_COVERAGES];
+int i=coverage_index(ps->coverage), k;
+
+if(i>=0)
+  {
+  curve = sd ? &models->model[ps->tool][ps->focus][i].length_sd : &models->model[ps->tool][ps->focus][i].length_mean;
+  if(curve->below.form==NO_CURVE) { return 0; }
+  *value = curve_value(curve, ps->target_length, 0.0);
+  return 1;
+  }
+if(!level_values(models, ps, sd, ps->target_length, values)) { return 0; }
+for(i=0; i<NUMBER_OF_COVERAGES; i++) { levels[i] = coverage_levels[i]; }
+for(k=0; coverage_levels[k+1]<ps->coverage; k++) { ; }
+*value = monotone_interpolate(levels, values, NUMBER_OF_COVERAGES, k, ps->coverage);
+return 1;
+} /* end of length_value() */
+
+
+/* the expected distribution of region lengths for a valid set, from the models it came from;
+   returns d->known, LENGTHS_NONE for a set that is not valid */
+int predict_lengths(const struct parameter_models *models, const struct parameter_set *ps,
+                    struct length_distribution *d)
+{
+double sd;
+
+memset(d, 0, sizeof(*d));
+if(ps->not_valid || !length_value(models, ps, 0, &d->mean)) { return d->known = LENGTHS_NONE; }
+if(d->mean<1.0) { d->mean = 1.0; }
+d->known = LENGTHS_MEAN;
+if(!length_value(models, ps, 1, &sd)) { return d->known; }
+d->variance = sd>0.0 ? sd*sd : 0.0;
+lognormal_histogram(d->mean, d->variance, d->histogram);
+return d->known = LENGTHS_FULL;
+} /* end of predict_lengths() */
+
+/******** END OF CODE FILE ********/
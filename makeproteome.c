@@ -0,0 +1,114 @@
+/****
+ **** makeproteome.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Writes a synthetic proteome in FASTA format, for repeatable timings of the scanners
+ ****  ('make bench'). Residues are drawn from the background frequencies fLPS uses, and a
+ ****  chosen proportion of the residues are in low-complexity regions: runs of one residue,
+ ****  or of a few residues repeated or mixed, of 8 to 80 residues. Sequence lengths are drawn
+ ****  from a roughly log-normal distribution. The output depends only on the options, with
+ ****  its own random number generator, so the same proteome can be made again.
+ ****
+ ****    makeproteome [-n sequences] [-l mean length] [-c low-complexity fraction] [-s seed]
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "scan.h"
+
+static unsigned long long state;
+
+/* xorshift64*, so that the output does not depend on the C library */
+static unsigned long long next_random(void)
+{
+state ^= state>>12;
+state ^= state<<25;
+state ^= state>>27;
+return state*2685821657736338717ULL;
+} /* end of next_random() */
+
+static double uniform(void) { return (next_random()>>11) * (1.0/9007199254740992.0); }
+
+
+static char background_residue(const double *cumulative)
+{
+double u=uniform();
+int r;
+
+for(r=0; r<NUMBER_OF_RESIDUES-1 && u>cumulative[r]; r++) { ; }
+return amino_acids[r];
+} /* end of background_residue() */
+
+
+/* writes a low-complexity region of the given length into sequence */
+static void low_complexity_region(char *sequence, int length, const double *cumulative)
+{
+char residues[3];
+int i, n_residues = 1 + next_random()%3, repeat = next_random()%2;
+
+for(i=0; i<n_residues; i++) { residues[i] = background_residue(cumulative); }
+for(i=0; i<length; i++)
+   {
+   if(uniform()<0.1) { sequence[i] = background_residue(cumulative); }  /* a little noise */
+   else if(repeat) { sequence[i] = residues[i%n_residues]; }
+   else { sequence[i] = residues[next_random()%n_residues]; }
+   }
+} /* end of low_complexity_region() */
+
+
+int main(int argc, char **argv)
+{
+double cumulative[NUMBER_OF_RESIDUES], sum=0.0, fraction=0.05, mean_length=400.0, sigma=0.6;
+char *sequence;
+int n_sequences=20000, seed=1, i, j, r, length, region, c;
+
+while((c = getopt(argc, argv, "n:l:c:s:")) != -1) {
+     switch(c) {
+     case 'n': n_sequences = atoi(optarg); break;
+     case 'l': mean_length = atof(optarg); break;
+     case 'c': fraction = atof(optarg); break;
+     case 's': seed = atoi(optarg); break;
+     default: fprintf(stderr, "usage: makeproteome [-n sequences] [-l mean length] [-c low-complexity fraction] [-s seed]\n"); exit(1);
+} /* end of switch */
+} /* end of while() getopt */
+if(n_sequences<0 || mean_length<10 || fraction<0 || fraction>1)
+  { fprintf(stderr, "makeproteome: options out of range\n"); exit(1); }
+
+for(r=0; r<NUMBER_OF_RESIDUES; r++) { sum += background_frequencies[r]; cumulative[r] = sum; }
+for(r=0; r<NUMBER_OF_RESIDUES; r++) { cumulative[r] /= sum; }
+state = 0x9E3779B97F4A7C15ULL*(seed+1);
+
+sequence = malloc(100*mean_length+1);
+for(i=0; i<n_sequences; i++)
+   {
+   /* log-normal lengths with the given mean, by the Box-Muller transform */
+   length = exp(log(mean_length) - sigma*sigma/2 + sigma*sqrt(-2.0*log(1.0-uniform()))*cos(2*M_PI*uniform()));
+   if(length<10) { length=10; }
+   if(length>100*mean_length) { length=100*mean_length; }
+
+   for(j=0; j<length; j++) { sequence[j] = background_residue(cumulative); }
+   /* regions of 8-80 residues, about fraction of the residues in all */
+   for(j=0; j<length; j+=region)
+      {
+      region = 8 + next_random()%73;
+      if(j+region<=length && uniform()<fraction) { low_complexity_region(sequence+j, region, cumulative); }
+      }
+
+   printf(">synthetic_%d length=%d\n", i+1, length);
+   for(j=0; j<length; j+=60) { printf("%.*s\n", length-j<60 ? length-j : 60, sequence+j); }
+   }
+free(sequence);
+exit(0);
+} /* end of main() */
+
+/******** END OF CODE FILE ********/
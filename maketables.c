@@ -0,0 +1,56 @@
+/****
+ **** maketables.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Build-time generator for parameter_tables.inc, which holds the output of
+ ****  calculate_parameters() for every tool, focus, coverage level and integer target length
+ ****  from MIN_TARGET_LENGTH to MAX_TARGET_LENGTH. Doubles are written as hexadecimal floating
+ ****  constants so that the compiled tables are bit-for-bit equal to the formulas.
+ ****
+ ****  to run (the Makefile does this):
+ ****   ./maketables > parameter_tables.inc
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "parameters.h"
+
+int main(int argc, char **argv)
+{
+int tool, focus, i, target_length;
+struct parameter_set ps;
+
+fprintf(stdout, "/* generated by maketables from parameters.c -- do not edit */\n");
+fprintf(stdout, "/* {K1, K2, threshold, L, small_m, big_m, lower_bound, upper_bound, not_valid, reason} */\n");
+for(tool=SEG; tool<=FLPS; tool++)
+   {
+   fprintf(stdout, "{\n");
+   for(focus=DIVERSE; focus<=NARROW; focus++)
+      {
+      fprintf(stdout, " {\n");
+      for(i=0; i<NUMBER_OF_COVERAGES; i++)
+         {
+         fprintf(stdout, "  { /* %s %s %d%% */\n", tool_name[tool], focus_name[focus], coverage_levels[i]);
+         for(target_length=MIN_TARGET_LENGTH; target_length<=MAX_TARGET_LENGTH; target_length++)
+            {
+            ps = calculate_parameters(tool, focus, target_length, coverage_levels[i]);
+            fprintf(stdout, "  {%a, %a, %a, %d, %d, %d, %d, %d, %d, %d},\n", ps.K1, ps.K2, ps.threshold,
+                    ps.L, ps.small_m, ps.big_m, ps.lower_bound, ps.upper_bound, ps.not_valid, ps.reason);
+            }
+         fprintf(stdout, "  },\n");
+         }
+      fprintf(stdout, " },\n");
+      }
+   fprintf(stdout, "},\n");
+   }
+exit(0);
+} /* end of main() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,384 @@
+/****
+ **** models.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Coefficient files, which replace some or all of the built-in parameter models, e.g. with
+ ****  models refitted to another proteome by the programs' calibration mode (-C). One line per
+ ****  curve, or per model's validity bounds, with '#' starting a comment:
+ ****
+ ****    SEG diverse 2 window 35 45 power 1.274 0.823 power 1.004 0.891
+ ****    SEG diverse 25 window - - power 1.507 0.762
+ ****    fLPS narrow 25 bounds 5 300 50
+ ****
+ ****  A curve is its breakpoints lo and hi ('-' for none), then the piece used up to lo and,
+ ****  if there are breakpoints, the piece used beyond hi; the two are averaged in between.
+ ****  Each piece is one of power (a*x^b), log (a*ln(x)+b), linear (a*x+b), constant (a) or
+ ****  offset (a added to K2 or M), with a and b always given. The bounds are the lower and
+ ****  upper target lengths fitted, and the length below which the model is excluded (0 for
+ ****  none). Models or curves that a file leaves out keep their previous values. A line
+ ****  'version 2' may start the file; version 1 files, which are the same without the curves
+ ****  length_mean and length_sd of the region lengths (lengths.c), are read as well.
+ ****
+ ****  Every model is checked once a file is loaded (check_models()): its window, cutoff and
+ ****  companion curves must have pieces, the length curves may have none, every coefficient
+ ****  must be finite, breakpoints must be in order, an offset companion must not be above
+ ****  the parameter it is from (K1 <= K2, m <= M), and the bounds must be target lengths in
+ ****  order. A file with a model that is not is refused as a whole, with MODELS_NOT_VALID.
+ ****
+ ****  The same models can also be written in a binary form, which is mapped into memory and
+ ****  used in place, so that loading takes only a few system calls. It is a 24-byte header:
+ ****     0  char[8]  "PMODELS" and '\0'
+ ****     8  uint32   version (MODELS_VERSION)
+ ****    12  uint32   0x01020304, in the byte order of the machine that wrote the file
+ ****    16  uint32   header size (24)
+ ****    20  uint32   size of the models that follow
+ ****  followed by a complete struct parameter_models, exactly as laid out in memory, with
+ ****  its padding zeroed. A binary file is only used by a build with the same version, byte
+ ****  order and structure layout; a text file works everywhere.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parameters.h"
+
+#define MODELS_MAGIC "PMODELS"
+#define MODELS_BYTE_ORDER 0x01020304u
+
+struct models_header {
+  char magic[8];
+  uint32_t version, byte_order, header_size, models_size;
+};
+
+static const char form_name[6][10] = {"none", "power", "log", "linear", "constant", "offset"};
+static const char curve_name[5][12] = {"window", "cutoff", "companion", "length_mean", "length_sd"};
+#define NUMBER_OF_CURVES 5
+
+
+/* the shortest form of x that reads back exactly */
+static void format_double(double x, char *s)
+{
+int precision;
+
+for(precision=6; precision<17; precision++)
+   {
+   sprintf(s, "%.*g", precision, x);
+   if(strtod(s, NULL)==x) { return; }
+   }
+sprintf(s, "%.17g", x);
+} /* end of format_double() */
+
+
+static void write_piece(FILE *out, const struct model_piece *piece)
+{
+char a[32], b[32];
+
+format_double(piece->a, a);
+format_double(piece->b, b);
+fprintf(out, " %s %s %s", form_name[piece->form], a, b);
+} /* end of write_piece() */
+
+
+static struct model_curve *model_curve(struct parameter_model *model, int c)
+{
+switch(c) {
+  case 0:  return &model->window;
+  case 1:  return &model->cutoff;
+  case 2:  return &model->companion;
+  case 3:  return &model->length_mean;
+  default: return &model->length_sd;
+} /* end of switch */
+} /* end of model_curve() */
+
+
+void write_models(FILE *out, const struct parameter_models *models)
+{
+const struct parameter_model *model;
+const struct model_curve *curve;
+int tool, focus, i, c;
+
+fprintf(out, "version %d\n", MODELS_VERSION);
+fprintf(out, "# parameter models: tool focus coverage curve lo hi form a b [form a b]\n");
+fprintf(out, "#                or tool focus coverage bounds lower upper excluded_below\n");
+for(tool=SEG; tool<=FLPS; tool++)
+   for(focus=DIVERSE; focus<=NARROW; focus++)
+      for(i=0; i<NUMBER_OF_COVERAGES; i++)
+         {
+         model = &models->model[tool][focus][i];
+         for(c=0; c<NUMBER_OF_CURVES; c++)
+            {
+            curve = model_curve((struct parameter_model *) model, c);
+            if(curve->below.form==NO_CURVE) { continue; }  /* a length curve not fitted */
+            fprintf(out, "%s %s %d %s", tool_name[tool], focus==DIVERSE ? "diverse" : "narrow", coverage_levels[i], curve_name[c]);
+            if(curve->lo==NO_BREAKPOINT) { fprintf(out, " - -"); write_piece(out, &curve->below); }
+            else {
+                 fprintf(out, " %d %d", curve->lo, curve->hi);
+                 write_piece(out, &curve->below);
+                 write_piece(out, &curve->above);
+                 }
+            fprintf(out, "\n");
+            }
+         fprintf(out, "%s %s %d bounds %d %d %d\n", tool_name[tool], focus==DIVERSE ? "diverse" : "narrow",
+                 coverage_levels[i], model->lower_bound, model->upper_bound, model->excluded_below);
+         }
+} /* end of write_models() */
+
+
+static int parse_form(const char *s)
+{
+int form;
+
+for(form=POWER; form<=OFFSET; form++) { if(!strcasecmp(s, form_name[form])) { return form; } }
+return -1;
+} /* end of parse_form() */
+
+
+/* whole numbers and coefficients, which must be the whole word; return 0 if they are not */
+static int parse_int(const char *s, int *x)
+{
+char *end;
+long y=strtol(s, &end, 10);
+
+if(end==s || *end || y<-NO_BREAKPOINT || y>NO_BREAKPOINT) { return 0; }
+*x = y;
+return 1;
+} /* end of parse_int() */
+
+
+static int parse_double(const char *s, double *x)
+{
+char *end;
+
+*x = strtod(s, &end);
+return end>s && !*end && isfinite(*x);
+} /* end of parse_double() */
+
+
+static int parse_piece(char **word, struct model_piece *piece)
+{
+int form;
+
+if((form = parse_form(word[0]))<0) { return 0; }
+piece->form = form;
+return parse_double(word[1], &piece->a) && parse_double(word[2], &piece->b);
+} /* end of parse_piece() */
+
+
+/* parses one line of a coefficient file into models; returns 0 if it is malformed */
+static int parse_model_line(char *line, struct parameter_models *models)
+{
+char *word[14];
+int n, tool, focus, i, c, lo, hi, coverage;
+struct model_curve *curve;
+struct parameter_model *model;
+
+for(n=0, word[0]=strtok(line, " \t\r\n"); word[n] && n<13; word[++n]=strtok(NULL, " \t\r\n")) { ; }
+if(n==2 && !strcasecmp(word[0], "version")) { return parse_int(word[1], &i) && i>=1 && i<=MODELS_VERSION; }
+if(n<7) { return 0; }
+
+if(!strcasecmp(word[0], tool_name[SEG])) { tool=SEG; }
+else if(!strcasecmp(word[0], tool_name[FLPS])) { tool=FLPS; }
+else { return 0; }
+if(!strcasecmp(word[1], focus_name[DIVERSE])) { focus=DIVERSE; }
+else if(!strcasecmp(word[1], focus_name[NARROW])) { focus=NARROW; }
+else { return 0; }
+if(!parse_int(word[2], &coverage) || (i = coverage_index(coverage))<0) { return 0; }
+model = &models->model[tool][focus][i];
+
+if(!strcasecmp(word[3], "bounds"))
+  {
+  return n==7 && parse_int(word[4], &model->lower_bound) && parse_int(word[5], &model->upper_bound)
+         && parse_int(word[6], &model->excluded_below);
+  }
+
+for(c=0; c<NUMBER_OF_CURVES && strcasecmp(word[3], curve_name[c]); c++) { ; }
+if(c==NUMBER_OF_CURVES) { return 0; }
+curve = model_curve(model, c);
+
+if(!strcmp(word[4], "-") && !strcmp(word[5], "-"))
+  {
+  if(n!=9 || !parse_piece(word+6, &curve->below)) { return 0; }
+  curve->lo = curve->hi = NO_BREAKPOINT;
+  memset(&curve->above, 0, sizeof(curve->above));
+  return 1;
+  }
+if(n!=12 || !parse_int(word[4], &lo) || !parse_int(word[5], &hi) || hi<lo) { return 0; }
+curve->lo = lo;
+curve->hi = hi;
+return parse_piece(word+6, &curve->below) && parse_piece(word+9, &curve->above);
+} /* end of parse_model_line() */
+
+
+static int check_piece(const struct model_piece *piece)
+{
+return piece->form>=POWER && piece->form<=OFFSET && isfinite(piece->a) && isfinite(piece->b);
+} /* end of check_piece() */
+
+
+/* a curve without breakpoints has only its lower piece; the length curves need none at all */
+static int check_curve(const struct model_curve *curve, int needed)
+{
+if(!needed && curve->below.form==NO_CURVE && curve->above.form==NO_CURVE) { return 1; }
+if(curve->lo==NO_BREAKPOINT && curve->hi==NO_BREAKPOINT) { return check_piece(&curve->below); }
+return curve->lo<=curve->hi && curve->hi<NO_BREAKPOINT && check_piece(&curve->below) && check_piece(&curve->above);
+} /* end of check_curve() */
+
+
+/* whether a model can be evaluated, as described at the top */
+static int check_model(const struct parameter_model *model)
+{
+int c;
+
+for(c=0; c<NUMBER_OF_CURVES; c++) { if(!check_curve(model_curve((struct parameter_model *) model, c), c<3)) { return 0; } }
+if((model->companion.below.form==OFFSET && model->companion.below.a>0.0)
+   || (model->companion.above.form==OFFSET && model->companion.above.a>0.0)) { return 0; }
+return model->lower_bound>=MIN_TARGET_LENGTH && model->lower_bound<=model->upper_bound
+       && model->upper_bound<=MAX_TARGET_LENGTH && model->excluded_below>=0;
+} /* end of check_model() */
+
+
+/* returns the number of models that are not valid, 0 if they all are */
+int check_models(const struct parameter_models *models)
+{
+int tool, focus, i, errors=0;
+
+for(tool=SEG; tool<=FLPS; tool++)
+   for(focus=DIVERSE; focus<=NARROW; focus++)
+      for(i=0; i<NUMBER_OF_COVERAGES; i++) { errors += !check_model(&models->model[tool][focus][i]); }
+return errors;
+} /* end of check_models() */
+
+
+/* reads a coefficient file over models; returns 0, MODELS_CANNOT_OPEN, the number of the first
+   malformed line, or MODELS_NOT_VALID if the models it leaves are not all valid */
+int read_models(const char *filename, struct parameter_models *models)
+{
+FILE *in;
+char line[1024], *p;
+int line_number=0;
+
+if(!(in = fopen(filename, "r"))) { return MODELS_CANNOT_OPEN; }
+while(fgets(line, sizeof(line), in))
+     {
+     line_number++;
+     if((p = strchr(line, '#'))) { *p='\0'; }
+     for(p=line; *p==' ' || *p=='\t'; p++) { ; }
+     if(*p=='\0' || *p=='\n' || *p=='\r') { continue; }
+     if(!parse_model_line(p, models)) { fclose(in); return line_number; }
+     }
+fclose(in);
+return check_models(models) ? MODELS_NOT_VALID : 0;
+} /* end of read_models() */
+
+
+
+/*  *  *  * BINARY COEFFICIENT FILES *  *  *  */
+
+static void copy_curve(struct model_curve *to, const struct model_curve *from)
+{
+to->lo=from->lo; to->hi=from->hi;
+to->below.form=from->below.form; to->below.a=from->below.a; to->below.b=from->below.b;
+to->above.form=from->above.form; to->above.a=from->above.a; to->above.b=from->above.b;
+} /* end of copy_curve() */
+
+
+/* copies the models field by field, so that the padding in the copy is zero */
+static void copy_models(struct parameter_models *copy, const struct parameter_models *models)
+{
+const struct parameter_model *from;
+struct parameter_model *to;
+int tool, focus, i, c;
+
+memset(copy, 0, sizeof(*copy));
+for(tool=SEG; tool<=FLPS; tool++)
+   for(focus=DIVERSE; focus<=NARROW; focus++)
+      for(i=0; i<NUMBER_OF_COVERAGES; i++)
+         {
+         from = &models->model[tool][focus][i];
+         to = &copy->model[tool][focus][i];
+         for(c=0; c<NUMBER_OF_CURVES; c++) { copy_curve(model_curve(to, c), model_curve((struct parameter_model *) from, c)); }
+         to->lower_bound=from->lower_bound; to->upper_bound=from->upper_bound; to->excluded_below=from->excluded_below;
+         }
+} /* end of copy_models() */
+
+
+void write_models_binary(FILE *out, const struct parameter_models *models)
+{
+struct models_header header;
+struct parameter_models *copy;
+
+memset(&header, 0, sizeof(header));
+memcpy(header.magic, MODELS_MAGIC, sizeof(MODELS_MAGIC));
+header.version = MODELS_VERSION;
+header.byte_order = MODELS_BYTE_ORDER;
+header.header_size = sizeof(header);
+header.models_size = sizeof(struct parameter_models);
+copy = malloc(sizeof(struct parameter_models));
+copy_models(copy, models);
+fwrite(&header, sizeof(header), 1, out);
+fwrite(copy, sizeof(struct parameter_models), 1, out);
+free(copy);
+} /* end of write_models_binary() */
+
+
+/* maps a binary coefficient file; returns NULL, with *error set to MODELS_CANNOT_OPEN, to
+   MODELS_NOT_BINARY or MODELS_INCOMPATIBLE if it is not a binary file that this build can use,
+   or to MODELS_NOT_VALID if its models are not all valid */
+static const struct parameter_models *map_models(const char *filename, int *error)
+{
+struct models_header header;
+struct stat st;
+void *map;
+int fd;
+
+if((fd = open(filename, O_RDONLY))<0) { *error=MODELS_CANNOT_OPEN; return NULL; }
+if(fstat(fd, &st) || read(fd, &header, sizeof(header))!=sizeof(header) || memcmp(header.magic, MODELS_MAGIC, sizeof(MODELS_MAGIC)))
+  { close(fd); *error=MODELS_NOT_BINARY; return NULL; }
+if(header.version!=MODELS_VERSION || header.byte_order!=MODELS_BYTE_ORDER || header.header_size!=sizeof(header)
+   || header.models_size!=sizeof(struct parameter_models) || st.st_size!=sizeof(header)+sizeof(struct parameter_models))
+  { close(fd); *error=MODELS_INCOMPATIBLE; return NULL; }
+map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+close(fd);
+if(map==MAP_FAILED) { *error=MODELS_CANNOT_OPEN; return NULL; }
+if(check_models((const struct parameter_models *) ((const char *) map + sizeof(header))))
+  { munmap(map, st.st_size); *error=MODELS_NOT_VALID; return NULL; }
+return (const struct parameter_models *) ((const char *) map + sizeof(header));
+} /* end of map_models() */
+
+
+/* opens a coefficient file of either kind: a binary one is mapped, and a text one is read over a
+   copy of the built-in models. Returns NULL on failure, with *error set to MODELS_CANNOT_OPEN,
+   MODELS_INCOMPATIBLE, MODELS_NOT_VALID or the number of the first malformed line of a text file */
+const struct parameter_models *open_models(const char *filename, int *error)
+{
+const struct parameter_models *mapped;
+struct parameter_models *models;
+
+if((mapped = map_models(filename, error))) { return mapped; }
+if(*error!=MODELS_NOT_BINARY) { return NULL; }
+
+models = malloc(sizeof(struct parameter_models));
+*models = builtin_models;
+if((*error = read_models(filename, models)))
+  {
+  free(models);
+  return NULL;
+  }
+return models;
+} /* end of open_models() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,351 @@
+/****
+ **** parameters.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  The fitted parameter models for SEG and fLPS, for a given target length of low-complexity
+ ****  or compositionally-biased region, focus and estimated protein coverage.
+ ****
+ ****  Each model is three curves of the target length: the window (SEG L or fLPS M), the
+ ****  cutoff (SEG K2 or fLPS t) and the companion (SEG K1 or fLPS m), which is usually an
+ ****  offset from K2 or M. A curve may change form at a breakpoint, with the two pieces
+ ****  averaged over a blend zone between them. The built-in models below are those of the
+ ****  paper; others can be read from a coefficient file (models.c) and evaluated the same way.
+ ****
+ ****  Citation:
+ ****    Harrison, PM. "Optimal strategies for discovery of low-complexity or compositionally-biased regions
+ ****     in proteins", submitted.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "parameters.h"
+
+const int coverage_levels[NUMBER_OF_COVERAGES] = {2, 5, 10, 25, 40};
+const char tool_name[2][6] = {"SEG", "fLPS"};
+const char focus_name[2][10] = {"DIVERSE", "NARROW"};
+
+#define SINGLE(form, a, b) { NO_BREAKPOINT, NO_BREAKPOINT, {form, a, b}, {NO_CURVE, 0, 0} }
+#define SPLIT(lo, hi, form1, a1, b1, form2, a2, b2) { lo, hi, {form1, a1, b1}, {form2, a2, b2} }
+
+/* the fitted models, by [tool][focus][coverage]: window, cutoff, companion and the validity
+   bounds. The curves of the region lengths are left to calibration, since the models were
+   fitted to the target lengths and say nothing more about the lengths of the regions found */
+const struct parameter_models builtin_models = { {
+ { { /* SEG DIVERSE */
+    { SPLIT(35, 45, POWER, 1.274, 0.823, POWER, 1.004, 0.891), SPLIT(35, 45, LOG, 0.701, 0.155, LOG, 0.447, 1.038),
+      SINGLE(OFFSET, -0.3, 0), 5, 200, 0 },
+    { SPLIT(50, 50, POWER, 1.385, 0.801, POWER, 0.747, 0.912), SPLIT(50, 50, LOG, 0.716, 0.381, LOG, 0.337, 1.883),
+      SPLIT(50, 50, OFFSET, -0.3, 0, OFFSET, -0.4, 0), 5, 300, 0 },
+    { SPLIT(45, 55, POWER, 1.376, 0.799, POWER, 1.298, 0.809), SPLIT(45, 55, LOG, 0.69, 0.625, LOG, 0.347, 1.93),
+      SINGLE(OFFSET, -0.3, 0), 5, 300, 0 },
+    { SINGLE(POWER, 1.507, 0.762), SPLIT(45, 55, LOG, 0.476, 1.566, LOG, 0.314, 2.221),
+      SINGLE(OFFSET, -0.3, 0), 5, 300, 0 },
+    { SPLIT(55, 65, POWER, 1.491, 0.793, POWER, 1.138, 0.86), SPLIT(55, 65, LOG, 0.581, 1.316, LOG, 0.28, 2.442),
+      SINGLE(OFFSET, -0.2, 0), 10, 300, 0 } },
+  { /* SEG NARROW: L is the target length */
+    { SINGLE(LINEAR, 1, 0), SPLIT(45, 55, LOG, 0.818, -0.245, LOG, 0.418, 1.206), SINGLE(OFFSET, 0, 0), 5, 250, 0 },
+    { SINGLE(LINEAR, 1, 0), SPLIT(45, 55, LOG, 0.824, -0.003, LOG, 0.355, 1.731), SINGLE(OFFSET, 0, 0), 5, 300, 0 },
+    { SINGLE(LINEAR, 1, 0), SPLIT(45, 55, LOG, 0.803, 0.251, LOG, 0.3, 2.135), SINGLE(OFFSET, 0, 0), 5, 300, 0 },
+    { SINGLE(LINEAR, 1, 0), SPLIT(45, 55, LOG, 0.788, 0.499, LOG, 0.278, 2.405), SINGLE(OFFSET, 0, 0), 5, 300, 0 },
+    { SINGLE(LINEAR, 1, 0), SPLIT(45, 55, LOG, 0.705, 0.887, LOG, 0.257, 2.596), SINGLE(OFFSET, 0, 0), 5, 250, 0 } } },
+ { { /* fLPS DIVERSE */
+    { SINGLE(POWER, 2.534, 0.506), SINGLE(LINEAR, -0.153, -3.994), SINGLE(OFFSET, -2, 0), 5, 100, 0 },
+    { SINGLE(POWER, 3.46, 0.508), SINGLE(LINEAR, -0.098, -3.305), SINGLE(OFFSET, -4, 0), 5, 200, 0 },
+    { SINGLE(POWER, 3.912, 0.543), SINGLE(LINEAR, -0.055, -3.635), SINGLE(OFFSET, -10, 0), 5, 250, 0 },
+    { SPLIT(105, 105, POWER, 5.647, 0.56, POWER, 6.096, 0.552), SPLIT(105, 105, LINEAR, -0.039, -2.381, LINEAR, -0.031, -2.93),
+      SPLIT(105, 105, POWER, 0.872, 0.797, OFFSET, -50, 0), 5, 300, 0 },
+    { SPLIT(105, 105, POWER, 9.82, 0.522, POWER, 11.126, 0.484), SPLIT(105, 105, LINEAR, -0.022, -2.709, LINEAR, -0.025, -2.762),
+      SPLIT(105, 105, POWER, 0.481, 0.876, OFFSET, -80, 0), 5, 300, 16 } },
+  { /* fLPS NARROW: m is M */
+    { SINGLE(POWER, 2.324, 0.539), SINGLE(LINEAR, -0.149, -3.883), SINGLE(OFFSET, 0, 0), 5, 100, 11 },
+    { SINGLE(POWER, 2.976, 0.556), SPLIT(28, 32, LINEAR, -0.127, -2.183, LINEAR, -0.09, -3.173),
+      SINGLE(OFFSET, 0, 0), 5, 200, 11 },
+    { SINGLE(POWER, 3.493, 0.572), SINGLE(LINEAR, -0.058, -2.731), SINGLE(OFFSET, 0, 0), 5, 200, 11 },
+    { SINGLE(POWER, 3.394, 0.672), SPLIT(90, 90, CONSTANT, -4.0, 0, LINEAR, -0.028, -1.695),
+      SINGLE(OFFSET, 0, 0), 5, 300, 50 },
+    { SINGLE(POWER, 0.889, 0.977), SINGLE(CONSTANT, -4.0, 0), SINGLE(OFFSET, 0, 0), 5, 300, 100 } } } } };
+
+
+/*  *  *  * EVALUATION *  *  *  */
+
+/* base is the quantity an OFFSET is taken from */
+static double piece_value(const struct model_piece *piece, double x, double base)
+{
+switch(piece->form) {
+  case POWER:    return piece->a * pow(x, piece->b);
+  case LOG:      return piece->a * log(x) + piece->b;
+  case LINEAR:   return piece->a * x + piece->b;
+  case CONSTANT: return piece->a;
+  case OFFSET:   return base + piece->a;
+  default:       return 0.0;
+} /* end of switch */
+} /* end of piece_value() */
+
+
+/* the lower piece up to lo, the upper piece beyond hi, and their mean in between */
+double curve_value(const struct model_curve *curve, double x, double base)
+{
+if(x<=curve->lo) { return piece_value(&curve->below, x, base); }
+if(x>curve->hi) { return piece_value(&curve->above, x, base); }
+return (piece_value(&curve->below, x, base) + piece_value(&curve->above, x, base))/2.0;
+} /* end of curve_value() */
+
+
+/* the window, cutoff and companion curves of a model at x */
+static void model_values(const struct parameter_model *model, enum parameter_tool tool, double x, double *v)
+{
+v[0] = curve_value(&model->window, x, 0.0);
+v[1] = curve_value(&model->cutoff, x, 0.0);
+v[2] = curve_value(&model->companion, x, tool==SEG ? v[1] : round(v[0]));
+} /* end of model_values() */
+
+
+/* whether a value to be rounded, or compared with a limit, is so close to the boundary that the
+   same value computed another way (evaluate_grid()) could fall on the other side of it */
+#define FRAGILE 1e-9
+static int near_half(double y) { return fabs(fabs(y-trunc(y))-0.5) < FRAGILE*(1.0+fabs(y)); }
+static int near_limit(double y, double limit) { return fabs(y-limit) < FRAGILE*(1.0+fabs(limit)); }
+
+
+/* fills in the parameters from the values of the model's curves at x; returns 1 if they are fragile */
+static int fitted_parameters(const struct parameter_model *model, const double *v, double x, struct parameter_set *ps)
+{
+if(x<ps->lower_bound || x>ps->upper_bound) { ps->reason|=REASON_LENGTH; }
+if(x<model->excluded_below) { ps->reason|=REASON_EXCLUDED; }
+if(ps->tool==SEG)
+  {
+  ps->L = round(v[0]);
+  ps->K2 = v[1];
+  ps->K1 = v[2];
+  if(ps->K2>4.2) { ps->reason|=REASON_K2; }
+  return near_half(v[0]) || near_limit(v[1], 4.2);
+  }
+ps->big_m = round(v[0]);
+ps->threshold = v[1];
+ps->small_m = round(v[2]);
+if(ps->threshold>-3.0) { ps->reason|=REASON_THRESHOLD; }
+if(ps->small_m<5) { ps->reason|=REASON_SMALL_M; }
+if(ps->small_m>ps->big_m) { ps->reason|=REASON_M_ORDER; }
+return near_half(v[0]) || near_half(v[2]) || near_limit(v[1], -3.0);
+} /* end of fitted_parameters() */
+
+
+/*  *  *  * ENTRY POINTS *  *  *  */
+
+int coverage_index(int coverage)
+{
+int i;
+
+for(i=0; i<NUMBER_OF_COVERAGES; i++)
+   { if(coverage_levels[i]==coverage) { return i; } }
+return -1;
+} /* end of coverage_index() */
+
+
+/* the shape-preserving piecewise cubic through (x[i], y[i]), i = 0..n-1, at x[k]<=at<=x[k+1]: its
+   slopes are the weighted harmonic means of the neighbouring secants (Fritsch and Butland), or 0
+   where the data turn, so it never overshoots, and is monotone wherever the data are */
+double monotone_interpolate(const double *x, const double *y, int n, int k, double at)
+{
+double h[2], d[3], slope[2], w1, w2, t, t2, t3;
+int j, i;
+
+for(j=0; j<2; j++)
+   {
+   i = k+j;  /* the slope at x[i] */
+   if(i==0 || i==n-1)
+     {
+     /* an end: the three-point estimate, kept to the sign of the end secant */
+     h[0] = i==0 ? x[1]-x[0] : x[n-1]-x[n-2];
+     h[1] = i==0 ? x[2]-x[1] : x[n-2]-x[n-3];
+     d[0] = i==0 ? (y[1]-y[0])/h[0] : (y[n-1]-y[n-2])/h[0];
+     d[2] = i==0 ? (y[2]-y[1])/h[1] : (y[n-2]-y[n-3])/h[1];
+     slope[j] = ((2*h[0]+h[1])*d[0] - h[0]*d[2])/(h[0]+h[1]);
+     if(slope[j]*d[0]<=0) { slope[j]=0; }
+     else if(d[0]*d[2]<0 && fabs(slope[j])>fabs(3*d[0])) { slope[j] = 3*d[0]; }
+     continue;
+     }
+   h[0] = x[i]-x[i-1];
+   h[1] = x[i+1]-x[i];
+   d[0] = (y[i]-y[i-1])/h[0];
+   d[2] = (y[i+1]-y[i])/h[1];
+   if(d[0]*d[2]<=0) { slope[j]=0; continue; }
+   w1 = 2*h[1]+h[0];
+   w2 = h[1]+2*h[0];
+   slope[j] = (w1+w2)/(w1/d[0] + w2/d[2]);
+   }
+
+h[0] = x[k+1]-x[k];
+t = (at-x[k])/h[0];
+t2 = t*t;
+t3 = t2*t;
+return (2*t3-3*t2+1)*y[k] + (t3-2*t2+t)*h[0]*slope[0] + (-2*t3+3*t2)*y[k+1] + (t3-t2)*h[0]*slope[1];
+} /* end of monotone_interpolate() */
+
+
+/* parameters for a coverage between the fitted levels, from the values of every level's curves at
+   x: each curve is interpolated monotonically across the levels, then rounded and limited as a
+   fitted set would be, so each parameter lies between its values at the levels on either side.
+   The set is valid only where the sets of both levels on either side are: its length bounds are
+   the narrower of theirs, and it is excluded where either is. Returns 1 if the set is fragile */
+static int interpolated_parameters(const struct parameter_models *models, double v[][3], double x, struct parameter_set *ps)
+{
+const struct parameter_model *model;
+double levels[NUMBER_OF_COVERAGES], window[NUMBER_OF_COVERAGES];
+double cutoff[NUMBER_OF_COVERAGES], companion[NUMBER_OF_COVERAGES], y;
+int i, k, fragile=0;
+
+for(k=0; coverage_levels[k+1]<ps->coverage; k++) { ; }
+ps->lower_bound = MIN_TARGET_LENGTH;
+ps->upper_bound = MAX_TARGET_LENGTH;
+for(i=0; i<NUMBER_OF_COVERAGES; i++)
+   {
+   levels[i] = coverage_levels[i];
+   window[i] = v[i][0];
+   cutoff[i] = v[i][1];
+   /* the companion as an offset from K2 or M, which keeps m equal to M where it is at every level */
+   companion[i] = ps->tool==SEG ? v[i][2] - v[i][1] : v[i][2] - round(v[i][0]);
+   if(ps->tool==FLPS) { fragile |= near_half(v[i][0]); }
+   if(i!=k && i!=k+1) { continue; }
+   model = &models->model[ps->tool][ps->focus][i];
+   if(model->lower_bound>ps->lower_bound) { ps->lower_bound = model->lower_bound; }
+   if(model->upper_bound<ps->upper_bound) { ps->upper_bound = model->upper_bound; }
+   if(x<model->excluded_below) { ps->reason|=REASON_EXCLUDED; }
+   }
+if(x<ps->lower_bound || x>ps->upper_bound) { ps->reason|=REASON_LENGTH; }
+
+y = monotone_interpolate(levels, window, NUMBER_OF_COVERAGES, k, ps->coverage);
+fragile |= near_half(y);
+if(ps->tool==SEG)
+  {
+  ps->L = round(y);
+  ps->K2 = monotone_interpolate(levels, cutoff, NUMBER_OF_COVERAGES, k, ps->coverage);
+  ps->K1 = ps->K2 + monotone_interpolate(levels, companion, NUMBER_OF_COVERAGES, k, ps->coverage);
+  if(ps->K2>4.2) { ps->reason|=REASON_K2; }
+  return fragile || near_limit(ps->K2, 4.2);
+  }
+ps->big_m = round(y);
+ps->threshold = monotone_interpolate(levels, cutoff, NUMBER_OF_COVERAGES, k, ps->coverage);
+y = ps->big_m + monotone_interpolate(levels, companion, NUMBER_OF_COVERAGES, k, ps->coverage);
+ps->small_m = round(y);
+if(ps->threshold>-3.0) { ps->reason|=REASON_THRESHOLD; }
+if(ps->small_m<5) { ps->reason|=REASON_SMALL_M; }
+if(ps->small_m>ps->big_m) { ps->reason|=REASON_M_ORDER; }
+return fragile || near_half(y) || near_limit(ps->threshold, -3.0);
+} /* end of interpolated_parameters() */
+
+
+/* starts a set for the coverage, whose fitted level is i (-1 if it is between levels); returns 0
+   if no parameters can be calculated */
+static int start_parameters(const struct parameter_models *models, enum parameter_tool tool, enum calculation_type focus,
+                            double x, int coverage, int i, struct parameter_set *ps)
+{
+memset(ps, 0, sizeof(*ps));
+ps->tool=tool; ps->focus=focus;
+ps->target_length=lround(x); ps->coverage=coverage;
+ps->lower_bound=MIN_TARGET_LENGTH;
+
+if(i<0 && (coverage<MIN_COVERAGE || coverage>MAX_COVERAGE)) { ps->reason=REASON_NO_MODEL; ps->not_valid=1; return 0; }
+if(i>=0)
+  {
+  ps->lower_bound = models->model[tool][focus][i].lower_bound;
+  ps->upper_bound = models->model[tool][focus][i].upper_bound;
+  }
+if(x<1) { ps->reason=REASON_LENGTH; ps->not_valid=1; return 0; } /* the power laws are undefined here */
+return 1;
+} /* end of start_parameters() */
+
+
+/* the parameters at a fitted coverage level, or interpolated between the levels for a coverage
+   between them */
+struct parameter_set evaluate_model(const struct parameter_models *models, enum parameter_tool tool,
+                                    enum calculation_type focus, int target_length, int coverage)
+{
+struct parameter_set ps;
+double v[NUMBER_OF_COVERAGES][3];
+int i=coverage_index(coverage), j;
+
+if(!start_parameters(models, tool, focus, target_length, coverage, i, &ps)) { return ps; }
+if(i>=0)
+  {
+  model_values(&models->model[tool][focus][i], tool, target_length, v[i]);
+  fitted_parameters(&models->model[tool][focus][i], v[i], target_length, &ps);
+  }
+else {
+     for(j=0; j<NUMBER_OF_COVERAGES; j++) { model_values(&models->model[tool][focus][j], tool, target_length, v[j]); }
+     interpolated_parameters(models, v, target_length, &ps);
+     }
+ps.not_valid = ps.reason!=0;
+return ps;
+} /* end of evaluate_model() */
+
+
+/* evaluate_model() for many target lengths at once, which need not be whole numbers: the curves
+   are evaluated over all the lengths with the vector instructions isa (grid.c). Wherever a value
+   is so close to a rounding or limit boundary that it could matter, the set is recomputed as
+   evaluate_model() would, so L, m, M and the reasons are always those it gives; the other
+   parameters agree with it to within a few units in the last place. target_length is the
+   nearest whole number to the length */
+void evaluate_grid_isa(enum grid_isa isa, const struct parameter_models *models, enum parameter_tool tool,
+                       enum calculation_type focus, int coverage, const double *lengths, int n,
+                       struct parameter_set *sets)
+{
+const struct parameter_model *model;
+double window[NUMBER_OF_COVERAGES][GRID_CHUNK], cutoff[NUMBER_OF_COVERAGES][GRID_CHUNK];
+double companion[NUMBER_OF_COVERAGES][GRID_CHUNK], base[GRID_CHUNK], v[NUMBER_OF_COVERAGES][3];
+int i=coverage_index(coverage), first, last, chunk, j, k, start;
+
+first = i>=0 ? i : 0;
+last = i>=0 ? i : NUMBER_OF_COVERAGES-1;
+for(start=0; start<n; start+=GRID_CHUNK)
+   {
+   chunk = n-start<GRID_CHUNK ? n-start : GRID_CHUNK;
+   for(k=first; k<=last && (i>=0 || (coverage>=MIN_COVERAGE && coverage<=MAX_COVERAGE)); k++)
+      {
+      model = &models->model[tool][focus][k];
+      curve_values(isa, &model->window, lengths+start, NULL, chunk, window[k]);
+      curve_values(isa, &model->cutoff, lengths+start, NULL, chunk, cutoff[k]);
+      for(j=0; j<chunk; j++) { base[j] = tool==SEG ? cutoff[k][j] : round(window[k][j]); }
+      curve_values(isa, &model->companion, lengths+start, base, chunk, companion[k]);
+      }
+
+   for(j=0; j<chunk; j++)
+      {
+      if(!start_parameters(models, tool, focus, lengths[start+j], coverage, i, &sets[start+j])) { continue; }
+      for(k=first; k<=last; k++) { v[k][0] = window[k][j]; v[k][1] = cutoff[k][j]; v[k][2] = companion[k][j]; }
+      if(i>=0 ? fitted_parameters(&models->model[tool][focus][i], v[i], lengths[start+j], &sets[start+j])
+              : interpolated_parameters(models, v, lengths[start+j], &sets[start+j]))
+        {
+        /* fragile: the curves again, as evaluate_model() computes them */
+        start_parameters(models, tool, focus, lengths[start+j], coverage, i, &sets[start+j]);
+        for(k=first; k<=last; k++) { model_values(&models->model[tool][focus][k], tool, lengths[start+j], v[k]); }
+        if(i>=0) { fitted_parameters(&models->model[tool][focus][i], v[i], lengths[start+j], &sets[start+j]); }
+        else { interpolated_parameters(models, v, lengths[start+j], &sets[start+j]); }
+        }
+      sets[start+j].not_valid = sets[start+j].reason!=0;
+      } /* end of for each length */
+   } /* end of for each chunk */
+} /* end of evaluate_grid_isa() */
+
+
+void evaluate_grid(const struct parameter_models *models, enum parameter_tool tool, enum calculation_type focus,
+                   int coverage, const double *lengths, int n, struct parameter_set *sets)
+{
+evaluate_grid_isa(best_grid_isa(), models, tool, focus, coverage, lengths, n, sets);
+} /* end of evaluate_grid() */
+
+
+struct parameter_set calculate_parameters(enum parameter_tool tool, enum calculation_type focus,
+                                          int target_length, int coverage)
+{
+return evaluate_model(&builtin_models, tool, focus, target_length, coverage);
+} /* end of calculate_parameters() */
+
+/******** END OF CODE FILE ********/
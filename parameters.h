@@ -0,0 +1,180 @@
+/****
+ **** parameters.h
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Interface to the parameter models shared by SEGparameters and fLPSparameters.
+ ****  The functions here keep no global state, so they can be linked into other programs
+ ****  (libparameters.a or libparameters.so) and called from several threads at once.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#ifndef PARAMETERS_H
+#define PARAMETERS_H
+
+#include <stdio.h>
+
+enum parameter_tool {SEG, FLPS};
+enum calculation_type {DIVERSE, NARROW};
+
+#define NUMBER_OF_COVERAGES 5
+#define MIN_COVERAGE 2         /* the lowest and highest fitted levels; coverages between them */
+#define MAX_COVERAGE 40        /* are interpolated */
+#define MIN_TARGET_LENGTH 5
+#define MAX_TARGET_LENGTH 300
+
+/* reasons a parameter set is not valid; a set may have several */
+#define REASON_LENGTH     1   /* target length outside the fitted range for this coverage */
+#define REASON_K2         2   /* SEG: K2>4.2 */
+#define REASON_THRESHOLD  4   /* fLPS: t>0.001 */
+#define REASON_SMALL_M    8   /* fLPS: m<5 */
+#define REASON_EXCLUDED  16   /* no reliable fit for this combination of focus, coverage and length */
+#define REASON_NO_MODEL  32   /* coverage is outside the range of the fitted levels */
+#define REASON_M_ORDER   64   /* fLPS: m>M */
+
+extern const int coverage_levels[NUMBER_OF_COVERAGES];  /* 2, 5, 10, 25, 40 percent */
+extern const char tool_name[2][6];
+extern const char focus_name[2][10];
+
+struct parameter_set {
+  enum parameter_tool tool;
+  enum calculation_type focus;
+  int target_length;
+  int coverage;
+  int L;                 /* SEG window length */
+  double K1, K2;         /* SEG trigger and extension complexities */
+  int small_m, big_m;    /* fLPS minimum and maximum window sizes */
+  double threshold;      /* fLPS binomial P-value threshold, as log10(P) */
+  int lower_bound;       /* target lengths outside [lower_bound, upper_bound] are not valid */
+  int upper_bound;
+  int not_valid;
+  int reason;            /* REASON_ flags, 0 if valid */
+};
+
+/* the models; see parameters.c */
+enum curve_form {NO_CURVE, POWER, LOG, LINEAR, CONSTANT, OFFSET};
+#define NO_BREAKPOINT 1000000
+
+struct model_piece {
+  enum curve_form form;  /* POWER a*x^b, LOG a*ln(x)+b, LINEAR a*x+b, CONSTANT a, OFFSET base+a */
+  double a, b;
+};
+
+struct model_curve {
+  int lo, hi;            /* below up to lo, above beyond hi, their mean in between */
+  struct model_piece below, above;
+};
+
+struct parameter_model {
+  struct model_curve window;     /* SEG L, fLPS big_m */
+  struct model_curve cutoff;     /* SEG K2, fLPS threshold */
+  struct model_curve companion;  /* SEG K1, fLPS small_m; an OFFSET is from K2 or big_m */
+  int lower_bound, upper_bound;  /* the range of target lengths fitted */
+  int excluded_below;            /* shorter target lengths have no reliable fit */
+  struct model_curve length_mean;  /* the mean and standard deviation of the lengths of the regions */
+  struct model_curve length_sd;    /* found; NO_CURVE where they have not been fitted (lengths.c) */
+};
+
+struct parameter_models {
+  struct parameter_model model[2][2][NUMBER_OF_COVERAGES];  /* [tool][focus][coverage] */
+};
+
+extern const struct parameter_models builtin_models;
+
+int coverage_index(int coverage);
+double monotone_interpolate(const double *x, const double *y, int n, int k, double at);
+double curve_value(const struct model_curve *curve, double x, double base);
+struct parameter_set evaluate_model(const struct parameter_models *models, enum parameter_tool tool,
+                                    enum calculation_type focus, int target_length, int coverage);
+struct parameter_set calculate_parameters(enum parameter_tool tool, enum calculation_type focus,
+                                          int target_length, int coverage);  /* the built-in models */
+
+/* grid.c and parameters.c: the models over many target lengths at once, with vector instructions */
+enum grid_isa {GRID_SCALAR, GRID_SSE2, GRID_AVX2, GRID_AVX512};
+#define GRID_CHUNK 256
+extern const char grid_isa_name[4][8];
+int grid_isa_supported(enum grid_isa isa);
+enum grid_isa best_grid_isa(void);
+void curve_values(enum grid_isa isa, const struct model_curve *curve, const double *x, const double *base,
+                  int n, double *values);
+void evaluate_grid_isa(enum grid_isa isa, const struct parameter_models *models, enum parameter_tool tool,
+                       enum calculation_type focus, int coverage, const double *lengths, int n,
+                       struct parameter_set *sets);
+void evaluate_grid(const struct parameter_models *models, enum parameter_tool tool, enum calculation_type focus,
+                   int coverage, const double *lengths, int n, struct parameter_set *sets);
+int check_grid(enum grid_isa isa);
+
+/* models.c: coefficient files, as text or binary */
+#define MODELS_VERSION 2
+#define MODELS_CANNOT_OPEN   -1
+#define MODELS_NOT_BINARY    -2
+#define MODELS_INCOMPATIBLE  -3   /* a binary file from another version or kind of machine */
+#define MODELS_NOT_VALID     -4   /* a model that cannot be evaluated, e.g. with m > M */
+int check_models(const struct parameter_models *models);
+void write_models(FILE *out, const struct parameter_models *models);
+int read_models(const char *filename, struct parameter_models *models);
+void write_models_binary(FILE *out, const struct parameter_models *models);
+const struct parameter_models *open_models(const char *filename, int *error);
+
+/* tables.c: the same results served from tables generated at build time by maketables */
+struct parameter_set lookup_parameters(enum parameter_tool tool, enum calculation_type focus,
+                                       int target_length, int coverage);
+int check_tables(void);
+
+/* requests.c: batch requests */
+#define MAX_REQUEST_LENGTHS 4096
+#define MAX_REQUEST_COVERAGES 32   /* as many as a scanner takes in one pass */
+int parse_focus(const char *s, enum calculation_type *focuses);
+int parse_target_lengths(const char *s, int *lengths, int max_lengths);
+void write_target_lengths(FILE *out, const int *lengths, int n);
+int parse_coverages(const char *s, int *coverages, int max_coverages);
+int read_request(FILE *in, const enum calculation_type *default_focuses, int n_default,
+                 int *target_length, enum calculation_type *focuses);
+
+/* lengths.c: the expected distribution of the lengths of the regions a parameter set finds */
+#define LENGTH_BINS 8
+#define LENGTHS_NONE 0      /* how much of a length distribution is known */
+#define LENGTHS_MEAN 1
+#define LENGTHS_FULL 2      /* the mean, the variance and the histogram */
+extern const int length_bin_start[LENGTH_BINS];  /* 1, 10, 20, 40, 80, 160, 320, 640 residues */
+
+struct length_distribution {
+  int known;                      /* LENGTHS_ */
+  double mean, variance;
+  double histogram[LENGTH_BINS];  /* the expected proportion of the regions in each bin */
+};
+
+int length_bin(int length);
+void lognormal_histogram(double mean, double variance, double *histogram);
+int predict_lengths(const struct parameter_models *models, const struct parameter_set *ps,
+                    struct length_distribution *d);
+
+/* format.c: machine-readable output */
+enum output_format {TEXT_FORMAT, TSV_FORMAT, JSON_FORMAT, BINARY_FORMAT};
+#define PARAMETER_RECORD_SIZE 40
+int parse_output_format(const char *s);
+void pack_parameter_record(const struct parameter_set *ps, unsigned char *record);
+void unpack_parameter_record(const unsigned char *record, struct parameter_set *ps);
+void write_parameters(FILE *out, const struct parameter_set *ps, enum output_format format);
+void write_parameters_lengths(FILE *out, const struct parameter_set *ps, const struct length_distribution *d,
+                              enum output_format format);
+
+/* solve.c: the parameter sets within a budget for the window (SEG L, fLPS M) */
+int solve_parameters(const struct parameter_models *models, enum parameter_tool tool, enum calculation_type focus,
+                     int max_window, const int *coverages, int n_coverages, const int *lengths, int n_lengths,
+                     struct parameter_set *feasible);
+
+/* server.c: the parameter service on a Unix domain socket */
+#define PARAMETER_QUERY_SIZE 8
+void pack_parameter_query(enum parameter_tool tool, enum calculation_type focus, int target_length,
+                          int coverage, unsigned char *query);
+int serve_parameters(const char *path, const struct parameter_models *models, FILE *log);
+int connect_parameter_service(const char *path);
+int query_parameter_service(int fd, const unsigned char *queries, int n, unsigned char *records, int n_records);
+
+#endif
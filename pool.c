@@ -0,0 +1,345 @@
+/****
+ **** pool.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Multi-threaded scanning of FASTA input. The calling thread reads the input into batches
+ ****  of whole sequences, of roughly BATCH_RESIDUES residues each, so that one very long
+ ****  sequence makes a batch of its own while short ones are grouped, and deals them out in
+ ****  turn to the workers' deques. Each worker takes the oldest batch from its own deque and,
+ ****  when that is empty, steals the newest from another's, so the work balances itself however
+ ****  unevenly the sequence lengths fall. Each batch is scanned into its own output buffer, and
+ ****  the calling thread writes the buffers out strictly in input order (the reorder buffer),
+ ****  so the output is the same whatever the number of threads. At most MAX_BATCHES_PER_THREAD
+ ****  batches per worker are in flight at once, which bounds the memory used.
+ ****
+ ****  Nothing is allocated or freed per record or per batch once the first batches are done.
+ ****  Each batch keeps an arena (arena.c) for the input copied into it and the output written
+ ****  to its stream, which is reset when the batch is refilled, and each worker one for
+ ****  scan() to allocate the scratch space and regions of a record from, which is reset for
+ ****  each record. So each arena stops growing once it is as large as the largest batch or
+ ****  record has needed.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#define _GNU_SOURCE  /* fopencookie() */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "scan.h"
+
+#define BATCH_RESIDUES (1<<18)
+#define BATCH_RECORDS 4096
+#define MAX_BATCHES_PER_THREAD 4
+
+struct scan_batch {
+  long id;
+  int n, done;
+  struct fasta_record records[BATCH_RECORDS];
+  struct arena arena;        /* of the data and the output */
+  char *data;                /* the headers and sequences, each followed by '\0' */
+  size_t data_size, data_used;
+  FILE *out;                 /* the batch's own stream, which writes to output */
+  char *output;
+  size_t output_size, output_capacity;
+};
+
+struct deque {
+  pthread_mutex_t lock;
+  struct scan_batch **batches;  /* a ring of max_batches entries */
+  int first, n;
+};
+
+struct pool {
+  int n_threads, max_batches;
+  scan_function scan;
+  void *context;
+  struct deque *deques;
+  struct arena *arenas;      /* per worker */
+  pthread_mutex_t lock;      /* guards pending, finished and the batches' done flags */
+  pthread_cond_t work, done;
+  int pending, finished;     /* batches queued but not yet claimed by a worker; end of input */
+};
+
+struct worker {
+  struct pool *pool;
+  int thread;
+};
+
+
+/* the write function of a batch's stream */
+static ssize_t write_output(void *cookie, const char *buffer, size_t size)
+{
+struct scan_batch *batch=cookie;
+size_t need=batch->output_size+size;
+
+if(need>batch->output_capacity)
+  {
+  need = need>2*batch->output_capacity ? need : 2*batch->output_capacity;
+  batch->output = arena_grow(&batch->arena, batch->output, batch->output_size, need);
+  batch->output_capacity = need;
+  }
+memcpy(batch->output+batch->output_size, buffer, size);
+batch->output_size += size;
+return size;
+} /* end of write_output() */
+
+
+static struct scan_batch *new_batch(void)
+{
+struct scan_batch *batch;
+cookie_io_functions_t functions={NULL, write_output, NULL, NULL};
+
+batch = calloc(1, sizeof(struct scan_batch));
+batch->out = fopencookie(batch, "w", functions);
+return batch;
+} /* end of new_batch() */
+
+
+/* reads records into the batch until it is full; returns the number read. Records from a mapped
+   file are kept as they are, and others are copied into the batch */
+static int fill_batch(struct fasta_reader *fr, struct scan_batch *batch)
+{
+struct fasta_record record;
+size_t residues=0, need;
+char *p;
+int i;
+
+arena_reset(&batch->arena);
+batch->n=0;
+batch->data=NULL;
+batch->data_size = batch->data_used = 0;
+batch->output=NULL;
+batch->output_size = batch->output_capacity = 0;
+while(batch->n<BATCH_RECORDS && residues<BATCH_RESIDUES && fasta_next(fr, &record))
+     {
+     residues += record.length;
+     if(fr->map) { batch->records[batch->n++] = record; continue; }
+
+     need = batch->data_used + record.header_length + record.length + 2;
+     if(need>batch->data_size)
+       {
+       need = need>2*batch->data_size ? need : 2*batch->data_size;
+       batch->data = arena_grow(&batch->arena, batch->data, batch->data_used, need);
+       batch->data_size = need;
+       }
+     memcpy(batch->data+batch->data_used, record.header, record.header_length);
+     batch->data_used += record.header_length;
+     batch->data[batch->data_used++] = '\0';
+     memcpy(batch->data+batch->data_used, record.sequence, record.length);
+     batch->data_used += record.length;
+     batch->data[batch->data_used++] = '\0';
+     batch->records[batch->n].header_length = record.header_length;
+     batch->records[batch->n].length = record.length;
+     batch->records[batch->n].offset = record.offset;
+     batch->n++;
+     }
+if(fr->map) { return batch->n; }
+
+/* the data may have moved as it grew, so the pointers are set once it is complete */
+for(i=0, p=batch->data; i<batch->n; i++)
+   {
+   batch->records[i].header = p;
+   p += batch->records[i].header_length+1;
+   batch->records[i].sequence = p;
+   p += batch->records[i].length+1;
+   }
+return batch->n;
+} /* end of fill_batch() */
+
+
+static void scan_batch(struct pool *pool, struct scan_batch *batch, int thread)
+{
+int i;
+
+for(i=0; i<batch->n; i++)
+   {
+   arena_reset(&pool->arenas[thread]);
+   pool->scan(pool->context, thread, &batch->records[i], &pool->arenas[thread], batch->out);
+   }
+fflush(batch->out);
+} /* end of scan_batch() */
+
+
+/* the worker's own oldest batch, or else the newest from another worker's deque */
+static struct scan_batch *take_batch(struct pool *pool, int thread)
+{
+struct scan_batch *batch=NULL;
+struct deque *d;
+int i;
+
+for(i=0; !batch; i=(i+1)%pool->n_threads)
+   {
+   d = &pool->deques[(thread+i)%pool->n_threads];
+   pthread_mutex_lock(&d->lock);
+   if(d->n && i==0) { batch = d->batches[d->first]; d->first = (d->first+1)%pool->max_batches; d->n--; }
+   else if(d->n) { d->n--; batch = d->batches[(d->first+d->n)%pool->max_batches]; }
+   pthread_mutex_unlock(&d->lock);
+   }
+return batch;
+} /* end of take_batch() */
+
+
+static void *worker_thread(void *arg)
+{
+struct worker *worker=arg;
+struct pool *pool=worker->pool;
+struct scan_batch *batch;
+
+for(;;)
+   {
+   pthread_mutex_lock(&pool->lock);
+   while(!pool->pending && !pool->finished) { pthread_cond_wait(&pool->work, &pool->lock); }
+   if(!pool->pending) { pthread_mutex_unlock(&pool->lock); break; }
+   pool->pending--;  /* claims one of the queued batches, which take_batch() is then sure to find */
+   pthread_mutex_unlock(&pool->lock);
+
+   batch = take_batch(pool, worker->thread);
+   scan_batch(pool, batch, worker->thread);
+
+   pthread_mutex_lock(&pool->lock);
+   batch->done=1;
+   pthread_cond_signal(&pool->done);
+   pthread_mutex_unlock(&pool->lock);
+   }
+return NULL;
+} /* end of worker_thread() */
+
+
+/* waits for the oldest batch in flight to be scanned, writes out its output, and lets the
+   reader release the input it came from */
+static void write_batch(struct pool *pool, struct scan_batch *batch, struct fasta_reader *fr, FILE *out)
+{
+pthread_mutex_lock(&pool->lock);
+while(!batch->done) { pthread_cond_wait(&pool->done, &pool->lock); }
+pthread_mutex_unlock(&pool->lock);
+if(batch->output_size) { fwrite(batch->output, 1, batch->output_size, out); }
+if(batch->n) { fasta_release(fr, batch->records[batch->n-1].header); }
+} /* end of write_batch() */
+
+
+/* scans every record of the FASTA file with scan(), using n_threads worker threads, and writes
+   the output to out in input order; returns SCAN_CANNOT_OPEN if the file cannot be opened, or
+   SCAN_READ_ERROR if it could not be read to the end */
+int scan_fasta(const char *filename, int n_threads, scan_function scan, void *context, FILE *out)
+{
+return scan_fasta_selected(filename, NULL, 0, n_threads, scan, context, out);
+} /* end of scan_fasta() */
+
+
+/* scan_fasta() over only the records at the given offsets, if offsets is not NULL (fasta_select()) */
+int scan_fasta_selected(const char *filename, const long *offsets, int n_offsets, int n_threads,
+                        scan_function scan, void *context, FILE *out)
+{
+struct fasta_reader *fr;
+struct fasta_record record;
+struct arena arena={0};
+struct pool pool;
+struct worker *workers;
+struct scan_batch **reorder, *batch;
+struct deque *d;
+pthread_t *threads;
+long next_id=0, written=0;
+int i, result;
+
+if(!(fr = fasta_open(filename, n_threads))) { return SCAN_CANNOT_OPEN; }
+if(offsets) { fasta_select(fr, offsets, n_offsets); }
+if(n_threads<=1)
+  {
+  while(fasta_next(fr, &record))
+       {
+       arena_reset(&arena);
+       scan(context, 0, &record, &arena, out);
+       fasta_release(fr, record.header);
+       }
+  result = fr->error ? SCAN_READ_ERROR : 0;
+  fasta_close(fr);
+  arena_free(&arena);
+  return result;
+  }
+
+memset(&pool, 0, sizeof(pool));
+pool.n_threads = n_threads;
+pool.max_batches = MAX_BATCHES_PER_THREAD*n_threads;
+pool.scan = scan;
+pool.context = context;
+pthread_mutex_init(&pool.lock, NULL);
+pthread_cond_init(&pool.work, NULL);
+pthread_cond_init(&pool.done, NULL);
+pool.deques = calloc(n_threads, sizeof(struct deque));
+pool.arenas = calloc(n_threads, sizeof(struct arena));
+workers = malloc(n_threads*sizeof(struct worker));
+threads = malloc(n_threads*sizeof(pthread_t));
+for(i=0; i<n_threads; i++)
+   {
+   pthread_mutex_init(&pool.deques[i].lock, NULL);
+   pool.deques[i].batches = malloc(pool.max_batches*sizeof(struct scan_batch *));
+   workers[i].pool = &pool;
+   workers[i].thread = i;
+   pthread_create(&threads[i], NULL, worker_thread, &workers[i]);
+   }
+
+/* batch id % max_batches is its slot in the reorder buffer; the batches are reused once written */
+reorder = calloc(pool.max_batches, sizeof(struct scan_batch *));
+for(;;)
+   {
+   if(next_id-written==pool.max_batches)
+     { write_batch(&pool, reorder[written%pool.max_batches], fr, out); written++; }
+
+   if(!(batch = reorder[next_id%pool.max_batches])) { batch = reorder[next_id%pool.max_batches] = new_batch(); }
+   if(!fill_batch(fr, batch)) { break; }
+   batch->id = next_id++;
+   batch->done = 0;
+
+   d = &pool.deques[batch->id%n_threads];
+   pthread_mutex_lock(&d->lock);
+   d->batches[(d->first+d->n)%pool.max_batches] = batch;
+   d->n++;
+   pthread_mutex_unlock(&d->lock);
+
+   pthread_mutex_lock(&pool.lock);
+   pool.pending++;
+   pthread_cond_signal(&pool.work);
+   pthread_mutex_unlock(&pool.lock);
+   } /* end of reading the input */
+
+pthread_mutex_lock(&pool.lock);
+pool.finished=1;
+pthread_cond_broadcast(&pool.work);
+pthread_mutex_unlock(&pool.lock);
+for(; written<next_id; written++) { write_batch(&pool, reorder[written%pool.max_batches], fr, out); }
+for(i=0; i<n_threads; i++) { pthread_join(threads[i], NULL); }
+result = fr->error ? SCAN_READ_ERROR : 0;
+fasta_close(fr);
+
+for(i=0; i<pool.max_batches; i++)
+   {
+   if(!reorder[i]) { continue; }
+   fclose(reorder[i]->out);
+   arena_free(&reorder[i]->arena);
+   free(reorder[i]);
+   }
+for(i=0; i<n_threads; i++)
+   {
+   free(pool.deques[i].batches);
+   pthread_mutex_destroy(&pool.deques[i].lock);
+   arena_free(&pool.arenas[i]);
+   }
+free(pool.arenas);
+free(reorder);
+free(pool.deques);
+free(workers);
+free(threads);
+pthread_mutex_destroy(&pool.lock);
+pthread_cond_destroy(&pool.work);
+pthread_cond_destroy(&pool.done);
+return result;
+} /* end of scan_fasta_selected() */
+
+/******** END OF CODE FILE ********/
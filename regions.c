@@ -0,0 +1,105 @@
+/****
+ **** regions.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Lists of the regions found by the scanners, and the merging of regions found by several
+ ****  parameter sets in one pass into a single list labelled with the sets that found each one.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "scan.h"
+
+/* an empty list, whose regions are allocated from arena, or from the heap if it is NULL; a
+   list from an arena is let go with the arena and must be started again after it is reset */
+void start_regions(struct region_list *list, struct arena *arena)
+{
+list->regions = NULL;
+list->n = list->size = 0;
+list->arena = arena;
+} /* end of start_regions() */
+
+
+void add_region(struct region_list *list, int start, int end, int residue, double score)
+{
+if(list->n==list->size)
+  {
+  list->size = list->size ? 2*list->size : 64;
+  if(list->arena)
+    { list->regions = arena_grow(list->arena, list->regions, list->n*sizeof(struct region), list->size*sizeof(struct region)); }
+  else { list->regions = realloc(list->regions, list->size*sizeof(struct region)); }
+  }
+list->regions[list->n].start = start;
+list->regions[list->n].end = end;
+list->regions[list->n].residue = residue;
+list->regions[list->n].sets = 0;
+list->regions[list->n].score = score;
+list->n++;
+} /* end of add_region() */
+
+
+static int by_position(const void *a, const void *b)
+{
+const struct region *x=a, *y=b;
+
+if(x->start!=y->start) { return x->start - y->start; }
+if(x->end!=y->end) { return x->end - y->end; }
+return x->residue - y->residue;
+} /* end of by_position() */
+
+void sort_regions(struct region_list *list)
+{
+if(list->n>1) { qsort(list->regions, list->n, sizeof(struct region), by_position); }
+} /* end of sort_regions() */
+
+
+/* merges the regions of n_sets lists into one list in order of position; a region found
+   identically by several sets appears once, with the bits of all of those sets */
+void merge_labelled_regions(struct region_list *per_set, int n_sets, struct region_list *merged)
+{
+int s, i;
+struct region *region, *last;
+
+merged->n=0;
+for(s=0; s<n_sets; s++)
+   for(i=0; i<per_set[s].n; i++)
+      {
+      region = &per_set[s].regions[i];
+      add_region(merged, region->start, region->end, region->residue, region->score);
+      merged->regions[merged->n-1].sets = 1u<<s;
+      }
+sort_regions(merged);
+
+for(i=0, s=0; i<merged->n; i++)
+   {
+   region = &merged->regions[i];
+   last = s ? &merged->regions[s-1] : NULL;
+   if(last && last->start==region->start && last->end==region->end && last->residue==region->residue)
+     {
+     last->sets |= region->sets;
+     if(region->score<last->score) { last->score = region->score; }
+     }
+   else { merged->regions[s++] = *region; }
+   }
+merged->n = s;
+} /* end of merge_labelled_regions() */
+
+/* writes the coverage levels of the sets in mask to label, e.g. "~2%,~10%" */
+void coverage_label(const struct parameter_set *sets, unsigned int mask, char *label)
+{
+int s;
+char *p=label;
+
+*p='\0';
+for(s=0; mask; s++, mask>>=1)
+   { if(mask & 1u) { p += sprintf(p, "%s~%d%%", p==label ? "" : ",", sets[s].coverage); } }
+} /* end of coverage_label() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,130 @@
+/****
+ **** requests.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Parsing of batch requests shared by SEGparameters and fLPSparameters:
+ ****  lists and ranges of target lengths ("5-300", "10,15,20-30"), focus names
+ ****  ("diverse", "narrow", "both") and one-request-per-line input for batch mode, and the
+ ****  writing of lists of target lengths in the same form.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "parameters.h"
+
+/* returns the number of focuses named by s (1 or 2), written to focuses[] */
+int parse_focus(const char *s, enum calculation_type *focuses)
+{
+if(!strcmp(s, "both")) { focuses[0]=DIVERSE; focuses[1]=NARROW; return 2; }
+if(!strcmp(s, "narrow")) { focuses[0]=NARROW; }
+else { focuses[0]=DIVERSE; }
+return 1;
+} /* end of parse_focus() */
+
+
+/* parses a comma-separated list of target lengths and ranges into lengths[],
+   returns the number of lengths, or -1 if the list is malformed */
+int parse_target_lengths(const char *s, int *lengths, int max_lengths)
+{
+int n=0, first, last, target_length;
+char *end;
+
+while(*s)
+     {
+     first = last = strtol(s, &end, 10);
+     if(end==s) { return -1; }
+     s=end;
+     if(*s=='-')
+       {
+       s++;
+       last = strtol(s, &end, 10);
+       if(end==s || last<first) { return -1; }
+       s=end;
+       }
+     if(*s==',') { s++; }
+     else if(*s) { return -1; }
+
+     for(target_length=first; target_length<=last; target_length++)
+        {
+        if(target_length<MIN_TARGET_LENGTH || target_length>MAX_TARGET_LENGTH)
+          { fprintf(stderr, " target length %d is out of bounds, skipping it\n", target_length); continue; }
+        if(n==max_lengths) { fprintf(stderr, " too many target lengths, using the first %d\n", n); return n; }
+        lengths[n++]=target_length;
+        }
+     } /* end of while(*s) */
+return n;
+} /* end of parse_target_lengths() */
+
+
+/* writes a sorted list of target lengths as ranges, e.g. "5-37,40", in the form read above */
+void write_target_lengths(FILE *out, const int *lengths, int n)
+{
+int i, first;
+
+for(i=0; i<n; i++)
+   {
+   for(first=i; i+1<n && lengths[i+1]==lengths[i]+1; i++) { ; }
+   fprintf(out, "%s%d", first ? "," : "", lengths[first]);
+   if(i>first) { fprintf(out, "-%d", lengths[i]); }
+   }
+} /* end of write_target_lengths() */
+
+
+/* parses a comma-separated list of coverages (percent) into coverages[], returns the number of
+   coverages, or -1 if the list is malformed or has a coverage outside the fitted levels' range */
+int parse_coverages(const char *s, int *coverages, int max_coverages)
+{
+int n=0;
+char *end;
+
+while(*s)
+     {
+     if(n==max_coverages) { return -1; }
+     coverages[n] = strtol(s, &end, 10);
+     if(end==s || coverages[n]<MIN_COVERAGE || coverages[n]>MAX_COVERAGE) { return -1; }
+     n++;
+     s=end;
+     if(*s==',') { s++; }
+     else if(*s) { return -1; }
+     }
+return n;
+} /* end of parse_coverages() */
+
+
+/* reads the next batch request, one per line: a target length, optionally followed by a focus,
+   without which it takes the n_default default focuses (those of -f). Blank lines and lines
+   starting with '#' are skipped. Returns the number of focuses written (1 or 2), or 0 at the
+   end of input. */
+int read_request(FILE *in, const enum calculation_type *default_focuses, int n_default,
+                 int *target_length, enum calculation_type *focuses)
+{
+char line[256], word[32];
+int n, i;
+
+while(fgets(line, sizeof(line), in))
+     {
+     n = sscanf(line, "%d %31s", target_length, word);
+     if(n<1)
+       {
+       if(sscanf(line, " %1s", word)==1 && word[0]!='#')
+         { fprintf(stderr, " unreadable request skipped: %s", line); }
+       continue;
+       }
+     if(*target_length<MIN_TARGET_LENGTH || *target_length>MAX_TARGET_LENGTH)
+       { fprintf(stderr, " target length %d is out of bounds, skipping it\n", *target_length); continue; }
+     if(n==2) { return parse_focus(word, focuses); }
+     for(i=0; i<n_default; i++) { focuses[i] = default_focuses[i]; }
+     return n_default;
+     }
+return 0;
+} /* end of read_request() */
+
+/******** END OF CODE FILE ********/
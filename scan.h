@@ -0,0 +1,252 @@
+/****
+ **** scan.h
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Interface to the sequence scanners built into libparameters, which apply the chosen
+ ****  parameter sets directly to FASTA input instead of through separate SEG or fLPS runs.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "parameters.h"
+
+/* residues are coded 0-19 in the order of amino_acids[], anything else is OTHER_RESIDUE */
+#define NUMBER_OF_RESIDUES 20
+#define OTHER_RESIDUE 20
+extern const char amino_acids[NUMBER_OF_RESIDUES+1];
+extern unsigned char residue_code[256];
+void encode_sequence(const char *sequence, int length, unsigned char *codes);
+
+
+/* arena.c: bump allocation of the objects of a batch of sequences, all let go at once */
+#define ARENA_BLOCK_BYTES (1<<16)  /* the least size of a block of an arena */
+struct arena_block;
+
+struct arena {
+  struct arena_block *block;  /* the newest block, which links to the older ones */
+  size_t total;               /* the size of all the blocks */
+  void *last;                 /* the latest allocation, which can grow in place */
+};
+
+void *arena_alloc(struct arena *a, size_t size);
+void *arena_grow(struct arena *a, void *p, size_t size, size_t new_size);
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+
+/* compress.c: compressed input, which fasta_open() recognises by its first bytes */
+enum compression { UNCOMPRESSED, GZIP, BGZF, ZSTD };
+struct decompressor;
+
+enum compression detect_compression(const unsigned char *p, size_t n);
+struct decompressor *decompress_open(FILE *in, const unsigned char *start, size_t n, enum compression type,
+                                     int n_threads);
+long decompress_read(struct decompressor *d, char *buffer, size_t size);
+void decompress_close(struct decompressor *d);
+
+
+/* fasta.c: FASTA input; a record's header and sequence are views that are not '\0'-terminated.
+   From a mapped file they stay valid until released with fasta_release(), otherwise only
+   until the next call to fasta_next() */
+struct fasta_record {
+  char *header;          /* the header line without '>' or the newline */
+  int header_length;
+  char *sequence;        /* the residues, without line breaks */
+  int length;
+  long offset;           /* of the record's '>' in a mapped file, otherwise -1 */
+};
+
+struct fasta_reader {
+  char *map;             /* a regular file, mapped */
+  size_t map_size, position, released;
+  FILE *in;              /* otherwise, a stream */
+  struct decompressor *decompressor;  /* of the stream, if it is compressed */
+  int error;             /* the stream could not be read or decompressed in full */
+  char *header, *sequence;
+  int header_size, sequence_size;
+  char *buffer;          /* a stream: the input read but not yet used */
+  size_t buffer_position, buffer_end;
+  const long *selected;  /* a mapped file: read only the records at these offsets, in order */
+  int n_selected, next_selected;
+};
+
+struct fasta_reader *fasta_open(const char *filename, int n_threads);  /* "-" is standard input */
+int fasta_next(struct fasta_reader *fr, struct fasta_record *record);
+void fasta_select(struct fasta_reader *fr, const long *offsets, int n);
+void fasta_release(struct fasta_reader *fr, const char *before);
+void fasta_close(struct fasta_reader *fr);
+
+
+/* regions.c: regions found by the scanners; start and end are 0-based, end exclusive */
+#define MAX_PARAMETER_SETS 32
+
+struct region {
+  int start, end;
+  int residue;           /* fLPS: the residue code of the bias, -1 for SEG */
+  unsigned int sets;     /* bit s is set if parameter set s found this region */
+  double score;          /* SEG: lowest window complexity; fLPS: lowest log10 P-value */
+};
+
+struct region_list {
+  struct region *regions;
+  int n, size;
+  struct arena *arena;   /* that the regions are allocated from, or NULL for the heap */
+};
+
+void start_regions(struct region_list *list, struct arena *arena);
+void add_region(struct region_list *list, int start, int end, int residue, double score);
+void sort_regions(struct region_list *list);
+void merge_labelled_regions(struct region_list *per_set, int n_sets, struct region_list *merged);
+void coverage_label(const struct parameter_set *sets, unsigned int mask, char *label);
+
+
+/* seg.c: SEG */
+#define SEG_FIXED_BITS 40  /* n*log2(n) is held in fixed point, with this many bits after the point */
+
+struct seg_scanner {
+  int window;            /* L */
+  double K1, K2;
+  long long *nlogn;      /* the increase in sum n*log2(n) when a count goes from n to n+1, n = 0..window-1 */
+  long long window_nlogn;  /* L*log2(L) */
+  double *complexity;    /* per window start, for the current sequence */
+  int complexity_size;
+  enum grid_isa isa;     /* of the search for trigger windows: GRID_AVX2 or GRID_SCALAR */
+};
+
+struct seg_scanner *seg_create(int window, double K1, double K2);
+void seg_complexity(struct seg_scanner *seg, const unsigned char *codes, int length);
+void seg_regions(struct seg_scanner *seg, int length, double K1, double K2, struct region_list *regions);
+void seg_scan(struct seg_scanner *seg, const unsigned char *codes, int length, struct region_list *regions);
+void seg_free(struct seg_scanner *seg);
+int check_seg(enum grid_isa isa);
+
+
+/* flps.c: fLPS */
+extern const double background_frequencies[NUMBER_OF_RESIDUES];
+
+/* the count of each residue before every position of a sequence, so that the count in any
+   window is the difference of two. They are kept to 16 bits, which is exact for any window
+   shorter than 1<<PREFIX_BLOCK_BITS, with the 32-bit counts at a checkpoint every
+   1<<PREFIX_BLOCK_BITS positions for longer stretches */
+#define PREFIX_BLOCK_BITS 16
+
+struct prefix_counts {
+  uint16_t (*low)[NUMBER_OF_RESIDUES];         /* [position][residue], the counts mod 1<<16, positions 0 to length */
+  uint32_t (*checkpoint)[NUMBER_OF_RESIDUES];  /* [position>>PREFIX_BLOCK_BITS][residue] */
+  int size, n_checkpoints;
+};
+
+void count_prefixes(struct prefix_counts *pc, const unsigned char *codes, int length);
+void free_prefixes(struct prefix_counts *pc);
+int check_prefixes(void);
+
+/* the count of residue r in positions start to end-1, for end-start < 1<<PREFIX_BLOCK_BITS */
+static inline int window_count(const struct prefix_counts *pc, int r, int start, int end)
+{
+return (uint16_t) (pc->low[end][r] - pc->low[start][r]);
+} /* end of window_count() */
+
+/* the count of residue r in positions start to end-1, for any stretch */
+static inline int stretch_count(const struct prefix_counts *pc, int r, int start, int end)
+{
+uint32_t below_end, below_start;
+
+below_end = pc->checkpoint[end>>PREFIX_BLOCK_BITS][r];
+below_end += (uint16_t) (pc->low[end][r] - below_end);
+below_start = pc->checkpoint[start>>PREFIX_BLOCK_BITS][r];
+below_start += (uint16_t) (pc->low[start][r] - below_start);
+return below_end-below_start;
+} /* end of stretch_count() */
+
+struct flps_set {
+  int small_m, big_m;
+  double threshold;      /* log10 P */
+};
+
+#define CACHE_LINE_FLOATS 16  /* the rows of the tables of log10 P start on a 64-byte cache line */
+#define FLPS_BANDS 4           /* bands of window sizes, and */
+#define FLPS_STRETCH 8         /* start positions, tested at a time for skipping */
+
+struct flps_scanner {
+  int small_m, big_m;    /* the range of window sizes covering all the sets */
+  int n_windows;         /* big_m-small_m+1 */
+  int stride;            /* big_m+1, rounded up to a whole number of cache lines */
+  int n_sets;
+  int shared;            /* the tables belong to the scanner this was cloned from */
+  struct flps_set sets[MAX_PARAMETER_SETS];
+  float *log_tail[NUMBER_OF_RESIDUES];   /* log10 P(X>=k) for window w at [(w-small_m)*stride+k] */
+  unsigned short *least[MAX_PARAMETER_SETS];  /* least count of residue r biased in window w at [r*n_windows+w-small_m] */
+  unsigned short *least_growing;         /* the same for any set with w as a longer window; big_m+1 if none */
+  short *reach[MAX_PARAMETER_SETS];      /* longest biased window for count k of residue r at [r*stride+k] */
+  unsigned int *starting, *growing;      /* per window size, sets with it as smallest / a longer window */
+  int n_bands, band_end[FLPS_BANDS];     /* the largest window size of each band */
+  uint16_t band_least[FLPS_BANDS][NUMBER_OF_RESIDUES];  /* least count of each residue biased in the band */
+  unsigned int biased[MAX_PARAMETER_SETS];                   /* residues biased in the set's smallest window */
+  struct region open[MAX_PARAMETER_SETS][NUMBER_OF_RESIDUES]; /* regions still growing, per set and residue */
+  struct prefix_counts prefix;                               /* of the current sequence */
+};
+
+struct flps_scanner *flps_create(int n_sets, const struct flps_set *sets, const double *background);
+void flps_scan(struct flps_scanner *flps, const unsigned char *codes, int length, struct region_list *regions);
+struct flps_scanner *flps_clone(const struct flps_scanner *flps);
+void flps_free(struct flps_scanner *flps);
+
+
+
+/* pool.c: multi-threaded scanning; scan() is called once per record, by the worker numbered
+   thread (0 to n_threads-1), and writes its output for the record to out. Anything it needs
+   only while it scans the record can be allocated from arena, the worker's own, which is
+   reset for each record */
+#define MAX_THREADS 256
+#define STREAM_OUTPUT_BYTES (1<<16)  /* the output buffer of the programs when scanning a stream */
+
+#define SCAN_CANNOT_OPEN -1
+#define SCAN_READ_ERROR  -2   /* the input ended early or was damaged, e.g. a truncated .gz file */
+
+typedef void (*scan_function)(void *context, int thread, const struct fasta_record *record, struct arena *arena,
+                              FILE *out);
+int scan_fasta(const char *filename, int n_threads, scan_function scan, void *context, FILE *out);
+int scan_fasta_selected(const char *filename, const long *offsets, int n_offsets, int n_threads,
+                        scan_function scan, void *context, FILE *out);
+
+
+/* summary.c: an index of per-sequence summaries, from which a rescan with other parameters
+   can tell which sequences cannot have regions without reading them */
+#define SUMMARY_VERSION 1
+#define SUMMARY_MIN_WINDOW 5
+#define SUMMARY_MAX_WINDOW 300
+#define SUMMARY_CANNOT_OPEN  -1
+#define SUMMARY_NOT_INDEX    -2
+#define SUMMARY_INCOMPATIBLE -3   /* another version, tool or kind of machine */
+#define SUMMARY_STALE        -4   /* the FASTA file has changed since the index was built */
+
+struct summary_index {
+  enum parameter_tool tool;
+  int n_sequences, first_window, last_window;
+  size_t row_size;
+  const unsigned char *rows;  /* per sequence: offset, length and the lowest value per window size */
+  void *map;
+  size_t map_size;
+};
+
+long build_summary_index(enum parameter_tool tool, const char *fasta, const char *filename, int n_threads);
+struct summary_index *open_summary_index(const char *filename, enum parameter_tool tool, const char *fasta, int *error);
+int select_sequences(const struct summary_index *index, const struct parameter_set *sets, int n_sets, long *offsets);
+void close_summary_index(struct summary_index *index);
+
+
+/* calibrate.c: refitting the models to a proteome */
+int calibrate_models(enum parameter_tool tool, const char *filename, const char *grid_file, int n_threads,
+                     struct parameter_models *models, FILE *report);
+
+#endif
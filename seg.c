@@ -0,0 +1,229 @@
+/****
+ **** seg.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  SEG scanning with the parameters L, K1 and K2 chosen by SEGparameters.
+ ****
+ ****  The complexity of a window is its Shannon entropy in bits,
+ ****     K = log2(L) - (1/L) * sum over residues of n*log2(n),
+ ****  where n is the count of each residue in the window. As the window slides one residue,
+ ****  only two counts change, so the sum is updated from a table of n*log2(n) in O(1). The
+ ****  table is in fixed point (SEG_FIXED_BITS), so the running sum is an exact integer: it
+ ****  does not drift along a long sequence, it is the same however it is added up, and a
+ ****  window of one residue has a complexity of exactly 0.
+ ****  Windows of complexity <= K1 trigger a region, which is extended over the neighbouring
+ ****  windows of complexity <= K2; overlapping regions are merged. Unlike the original SEG
+ ****  program, regions are not then trimmed to their most improbable subsequence.
+ ****
+ ****  Most windows trigger nothing, and with several parameter sets sharing a window (-a) the
+ ****  search for triggers is most of the work, so where AVX2 is available (chosen at run time,
+ ****  as for grid.c) it compares eight complexities at a time with K1, as does the extension
+ ****  to the right with K2. Vectorizing the sliding counts themselves, e.g. with packed 8-bit
+ ****  counts, does not pay: each step then needs the counts of the two residues that change
+ ****  out of the vector, which costs more than the O(1) update it replaces.
+ ****
+ ****  Reference:
+ ****    Wootton, JC & Federhen, S. 'Statistics of local complexity in amino acid sequences
+ ****    and sequence databases', (1993) Computers & Chemistry, 17: 149-163.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "scan.h"
+
+static long long fixed_nlogn(int n) { return n ? llround(n*log2((double) n)*(double) (1LL<<SEG_FIXED_BITS)) : 0; }
+
+struct seg_scanner *seg_create(int window, double K1, double K2)
+{
+struct seg_scanner *seg;
+int n;
+
+seg = calloc(1, sizeof(struct seg_scanner));
+seg->window = window;
+seg->K1 = K1;
+seg->K2 = K2;
+seg->nlogn = malloc(window*sizeof(long long));
+for(n=0; n<window; n++) { seg->nlogn[n] = fixed_nlogn(n+1)-fixed_nlogn(n); }
+seg->window_nlogn = fixed_nlogn(window);
+seg->isa = grid_isa_supported(GRID_AVX2) ? GRID_AVX2 : GRID_SCALAR;
+return seg;
+} /* end of seg_create() */
+
+
+/* fills seg->complexity[] for every window start of the sequence */
+void seg_complexity(struct seg_scanner *seg, const unsigned char *codes, int length)
+{
+int counts[NUMBER_OF_RESIDUES+1] = {0};
+int i, window=seg->window, n_windows=length-window+1;
+long long *increase=seg->nlogn, sum=0, below;
+double *complexity, scale=1.0/((double) window*(double) (1LL<<SEG_FIXED_BITS));
+
+if(n_windows<1) { return; }
+if(n_windows>seg->complexity_size)
+  {
+  seg->complexity_size = n_windows;
+  seg->complexity = realloc(seg->complexity, n_windows*sizeof(double));
+  }
+
+complexity = seg->complexity;
+
+/* below is L*log2(L) less the sum, which the table's rounding can leave a few units under 0 */
+for(i=0; i<window; i++) { sum += increase[counts[codes[i]]++]; }
+below = seg->window_nlogn-sum;
+complexity[0] = (below>0 ? below : 0)*scale;
+
+for(i=1; i<n_windows; i++)
+   {
+   sum -= increase[--counts[codes[i-1]]];
+   sum += increase[counts[codes[i+window-1]]++];
+   below = seg->window_nlogn-sum;
+   complexity[i] = (below>0 ? below : 0)*scale;
+   }
+} /* end of seg_complexity() */
+
+
+/* the first window from start on whose complexity is at most threshold or, with above, more than
+   it; n_windows if there is none */
+static int next_window(const double *complexity, int start, int n_windows, double threshold, int above)
+{
+int i;
+
+for(i=start; i<n_windows && (complexity[i]>threshold)!=above; i++) { ; }
+return i;
+} /* end of next_window() */
+
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+/* next_window(), eight windows at a time */
+static int next_window_avx2(const double *complexity, int start, int n_windows, double threshold, int above)
+{
+__m256d t=_mm256_set1_pd(threshold);
+int i, mask, flip=above ? 0 : 0xff;
+
+for(i=start; i+8<=n_windows; i+=8)
+   {
+   mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(complexity+i), t, _CMP_GT_OQ))
+          | _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(complexity+i+4), t, _CMP_GT_OQ))<<4;
+   if((mask ^= flip)) { return i+__builtin_ctz(mask); }
+   }
+return next_window(complexity, i, n_windows, threshold, above);
+} /* end of next_window_avx2() */
+
+#pragma GCC pop_options
+#endif
+
+
+static inline int find_window(const struct seg_scanner *seg, int start, int n_windows, double threshold, int above)
+{
+#if defined(__x86_64__)
+if(seg->isa==GRID_AVX2) { return next_window_avx2(seg->complexity, start, n_windows, threshold, above); }
+#endif
+return next_window(seg->complexity, start, n_windows, threshold, above);
+} /* end of find_window() */
+
+
+/* finds the regions for trigger and extension complexities K1 and K2 in the complexities
+   already calculated by seg_complexity(), so that several pairs can share one calculation */
+void seg_regions(struct seg_scanner *seg, int length, double K1, double K2, struct region_list *regions)
+{
+int i, left, right, n_windows=length-seg->window+1;
+double *complexity=seg->complexity, lowest;
+struct region *last;
+
+regions->n=0;
+
+for(i=0; i<n_windows; i++)
+   {
+   if((i = find_window(seg, i, n_windows, K1, 0))==n_windows) { break; }
+
+   /* extend the trigger window over neighbouring windows of low complexity */
+   left = right = i;
+   while(left>0 && complexity[left-1]<=K2) { left--; }
+   right = find_window(seg, right+1, n_windows, K2, 1)-1;
+   for(lowest=complexity[left], i=left+1; i<=right; i++)
+      { if(complexity[i]<lowest) { lowest=complexity[i]; } }
+
+   last = regions->n ? &regions->regions[regions->n-1] : NULL;
+   if(last && left<=last->end)
+     {
+     if(right+seg->window>last->end) { last->end = right+seg->window; }
+     if(lowest<last->score) { last->score = lowest; }
+     }
+   else { add_region(regions, left, right+seg->window, -1, lowest); }
+   i = right;
+   } /* end of for each window */
+} /* end of seg_regions() */
+
+
+void seg_scan(struct seg_scanner *seg, const unsigned char *codes, int length, struct region_list *regions)
+{
+seg_complexity(seg, codes, length);
+seg_regions(seg, length, seg->K1, seg->K2, regions);
+} /* end of seg_scan() */
+
+
+void seg_free(struct seg_scanner *seg)
+{
+free(seg->nlogn);
+free(seg->complexity);
+free(seg);
+} /* end of seg_free() */
+
+
+/*  *  *  * SELF-CHECK *  *  *  */
+
+/* returns the number of scans of random sequences, with runs of a few residues in them, in which
+   the regions found with the search for windows in isa differ from those found without it */
+int check_seg(enum grid_isa isa)
+{
+struct seg_scanner *seg;
+struct region_list regions={0}, reference={0};
+unsigned char codes[2000];
+unsigned long long state=88172645463325252ULL;
+int window, i, j, k, errors=0;
+
+for(window=5; window<=300; window+=7)
+   {
+   seg = seg_create(window, 0.0, 0.0);
+   for(k=0; k<20; k++)
+      {
+      for(i=0; i<2000; i++)
+         {
+         state ^= state<<13; state ^= state>>7; state ^= state<<17;
+         codes[i] = (i/100)%3 ? state%(NUMBER_OF_RESIDUES+1) : state%3;
+         }
+      seg_complexity(seg, codes, 2000);
+      for(j=0; j<8; j++)
+         {
+         seg->isa = GRID_SCALAR;
+         seg_regions(seg, 2000, 1.0+0.3*j, 1.3+0.3*j, &reference);
+         seg->isa = isa;
+         seg_regions(seg, 2000, 1.0+0.3*j, 1.3+0.3*j, &regions);
+         if(regions.n!=reference.n
+            || (regions.n && memcmp(regions.regions, reference.regions, regions.n*sizeof(struct region))))
+           { errors++; }
+         }
+      }
+   seg_free(seg);
+   }
+free(regions.regions);
+free(reference.regions);
+return errors;
+} /* end of check_seg() */
+
+/******** END OF CODE FILE ********/
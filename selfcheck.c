@@ -0,0 +1,50 @@
+/****
+ **** selfcheck.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Build-time self-check of libparameters: the generated tables must reproduce the
+ ****  formulas in parameters.c exactly, and grids evaluated with each set of vector
+ ****  instructions this processor has must give the same parameters as the formulas.
+ ****  The SEG scanner must also find the same regions with AVX2 as without, and the prefix
+ ****  counts of the fLPS scanner must give the same counts as counting, and the built-in
+ ****  models must pass the checks that coefficient files are held to.
+ ****  'make' runs this and stops if it fails.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "parameters.h"
+#include "scan.h"
+
+int main(int argc, char **argv)
+{
+int errors, isa;
+
+if((errors = check_models(&builtin_models)))
+  { fprintf(stderr, "selfcheck: %d built-in models are not valid\n", errors); exit(1); }
+errors = check_tables();
+if(errors)
+  { fprintf(stderr, "selfcheck: %d parameter table entries do not match the formulas\n", errors); exit(1); }
+
+for(isa=GRID_SCALAR; isa<=GRID_AVX512; isa++)
+   {
+   if(!grid_isa_supported(isa)) { continue; }
+   if((errors = check_grid(isa)))
+     { fprintf(stderr, "selfcheck: %d grid points evaluated with %s do not match the formulas\n", errors, grid_isa_name[isa]); exit(1); }
+   }
+if(grid_isa_supported(GRID_AVX2) && (errors = check_seg(GRID_AVX2)))
+  { fprintf(stderr, "selfcheck: %d SEG scans with avx2 do not match the scalar scans\n", errors); exit(1); }
+if((errors = check_prefixes()))
+  { fprintf(stderr, "selfcheck: %d residue counts from prefix counts are wrong\n", errors); exit(1); }
+
+exit(0);
+} /* end of main() */
+
+/******** END OF CODE FILE ********/
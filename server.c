@@ -0,0 +1,284 @@
+/****
+ **** server.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  A long-running parameter service on a Unix domain socket (the programs' -D option), so
+ ****  that programs needing parameters for many jobs can ask for them without starting a
+ ****  process each time. The models are held in memory, and any number of clients are served
+ ****  at once from a single thread with poll().
+ ****
+ ****  The protocol is binary. A client writes queries of PARAMETER_QUERY_SIZE bytes, all fields
+ ****  little-endian:
+ ****     0  uint8   tool (0 = SEG, 1 = fLPS)
+ ****     1  uint8   focus (0 = DIVERSE, 1 = NARROW)
+ ****     2  uint8   coverage (percent), or 0 for all the coverage levels
+ ****     3  uint8   reserved (0)
+ ****     4  int16   target_length
+ ****     6  uint16  reserved (0)
+ ****  and the server answers each with one parameter record of PARAMETER_RECORD_SIZE bytes, laid
+ ****  out as in format.c, or with one per coverage level, in increasing order, for coverage 0.
+ ****  Answers come back in the order the queries were sent. Queries may be pipelined: a client
+ ****  can write a whole batch of them, or keep writing while it reads, and the server answers
+ ****  every complete query that has arrived with a single write. A malformed query closes the
+ ****  connection.
+ ****
+ ****  A client whose answers cannot be written as fast as it asks is not read from until they
+ ****  have drained, so a client that never reads cannot make the server use unbounded memory.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "parameters.h"
+
+#define MAX_CLIENTS 1024
+#define READ_SIZE 65536
+#define MAX_PENDING_OUTPUT (1<<20)   /* stop reading a client with this much output unsent */
+
+struct client {
+  int fd;
+  unsigned char partial[PARAMETER_QUERY_SIZE];  /* the start of a query split across reads */
+  int n_partial;
+  int closing;           /* the client has finished sending; close once its answers are written */
+  unsigned char *output;
+  size_t output_size, output_start, output_end;
+};
+
+static volatile sig_atomic_t stopping;
+
+static void stop_serving(int signal_number) { (void) signal_number; stopping=1; }
+
+
+void pack_parameter_query(enum parameter_tool tool, enum calculation_type focus, int target_length,
+                          int coverage, unsigned char *query)
+{
+query[0]=tool;
+query[1]=focus;
+query[2]=coverage;
+query[3]=0;
+query[4]=target_length;
+query[5]=target_length>>8;
+query[6]=query[7]=0;
+} /* end of pack_parameter_query() */
+
+
+/* answers one query, appending the records to the client's output; returns 0 if it is malformed */
+static int answer_query(struct client *client, const unsigned char *query, const struct parameter_models *models)
+{
+struct parameter_set ps;
+int tool=query[0], focus=query[1], target_length=(short) (query[4] | query[5]<<8);
+int i, coverage, n = query[2] ? 1 : NUMBER_OF_COVERAGES;
+size_t need;
+
+if(tool>FLPS || focus>NARROW || query[3] || query[6] || query[7]) { return 0; }
+
+need = client->output_end + n*PARAMETER_RECORD_SIZE;
+if(need>client->output_size)
+  {
+  client->output_size = need>2*client->output_size ? need : 2*client->output_size;
+  client->output = realloc(client->output, client->output_size);
+  }
+for(i=0; i<n; i++)
+   {
+   coverage = query[2] ? query[2] : coverage_levels[i];
+   ps = models ? evaluate_model(models, tool, focus, target_length, coverage)
+               : lookup_parameters(tool, focus, target_length, coverage);
+   pack_parameter_record(&ps, client->output+client->output_end);
+   client->output_end += PARAMETER_RECORD_SIZE;
+   }
+return 1;
+} /* end of answer_query() */
+
+
+/* reads what the client has sent and answers the complete queries; returns 0 if the
+   connection should be closed at once */
+static int read_queries(struct client *client, const struct parameter_models *models, unsigned char *buffer)
+{
+ssize_t got;
+int i=0, n;
+
+if((got = read(client->fd, buffer, READ_SIZE))==0) { client->closing=1; return 1; }
+if(got<0) { return errno==EAGAIN || errno==EINTR; }
+
+if(client->output_start==client->output_end) { client->output_start = client->output_end = 0; }
+if(client->n_partial)
+  {
+  n = PARAMETER_QUERY_SIZE-client->n_partial < got ? PARAMETER_QUERY_SIZE-client->n_partial : got;
+  memcpy(client->partial+client->n_partial, buffer, n);
+  client->n_partial += n;
+  i = n;
+  if(client->n_partial<PARAMETER_QUERY_SIZE) { return 1; }
+  if(!answer_query(client, client->partial, models)) { return 0; }
+  client->n_partial = 0;
+  }
+for(; i+PARAMETER_QUERY_SIZE<=got; i+=PARAMETER_QUERY_SIZE)
+   { if(!answer_query(client, buffer+i, models)) { return 0; } }
+memcpy(client->partial, buffer+i, got-i);
+client->n_partial = got-i;
+return 1;
+} /* end of read_queries() */
+
+
+/* writes as much of the client's output as the socket takes; returns 0 on error */
+static int write_answers(struct client *client)
+{
+ssize_t n;
+
+while(client->output_start<client->output_end)
+     {
+     n = write(client->fd, client->output+client->output_start, client->output_end-client->output_start);
+     if(n<0) { return errno==EAGAIN || errno==EINTR; }
+     client->output_start += n;
+     }
+client->output_start = client->output_end = 0;
+return 1;
+} /* end of write_answers() */
+
+
+static void close_client(struct client *client)
+{
+close(client->fd);
+free(client->output);
+memset(client, 0, sizeof(*client));
+client->fd = -1;
+} /* end of close_client() */
+
+
+/* serves queries on a Unix domain socket at path until SIGINT or SIGTERM, with the given models,
+   or the built-in tables if models is NULL; returns -1 if the socket cannot be set up */
+int serve_parameters(const char *path, const struct parameter_models *models, FILE *log)
+{
+struct sockaddr_un address;
+struct sigaction action;
+struct pollfd *polled;
+struct client *clients;
+unsigned char *buffer;
+int listener, fd, i, n_clients=0, n_polled;
+
+if(strlen(path)>=sizeof(address.sun_path)) { return -1; }
+memset(&address, 0, sizeof(address));
+address.sun_family = AF_UNIX;
+strcpy(address.sun_path, path);
+if((listener = socket(AF_UNIX, SOCK_STREAM, 0))<0) { return -1; }
+unlink(path);
+if(bind(listener, (struct sockaddr *) &address, sizeof(address)) || listen(listener, 128))
+  { close(listener); return -1; }
+fcntl(listener, F_SETFL, O_NONBLOCK);
+
+memset(&action, 0, sizeof(action));
+action.sa_handler = stop_serving;
+sigaction(SIGINT, &action, NULL);
+sigaction(SIGTERM, &action, NULL);
+signal(SIGPIPE, SIG_IGN);
+stopping=0;
+if(log) { fprintf(log, " serving parameters on %s\n", path); }
+
+clients = malloc(MAX_CLIENTS*sizeof(struct client));
+polled = malloc((MAX_CLIENTS+1)*sizeof(struct pollfd));
+buffer = malloc(READ_SIZE);
+while(!stopping)
+     {
+     /* the listener is polled last, so polled[i] is clients[i] */
+     for(i=0; i<n_clients; i++)
+        {
+        polled[i].fd = clients[i].fd;
+        polled[i].events = !clients[i].closing && clients[i].output_end-clients[i].output_start<MAX_PENDING_OUTPUT ? POLLIN : 0;
+        if(clients[i].output_start<clients[i].output_end) { polled[i].events |= POLLOUT; }
+        }
+     n_polled = n_clients;
+     if(n_clients<MAX_CLIENTS) { polled[n_polled].fd = listener; polled[n_polled++].events = POLLIN; }
+     if(poll(polled, n_polled, -1)<0) { continue; }  /* EINTR: a signal to stop, perhaps */
+
+     for(i=0; i<n_clients; i++)
+        {
+        if(!polled[i].revents) { continue; }
+        if(polled[i].revents & POLLERR) { close_client(&clients[i]); continue; }
+        /* a hang-up may leave queries to read, but not from a client over its output limit,
+           which poll() reports hang-ups for even when it is not asked to read */
+        if((polled[i].revents & (POLLIN|POLLHUP)) && (polled[i].events & POLLIN)
+           && !read_queries(&clients[i], models, buffer))
+          { close_client(&clients[i]); continue; }
+        if(!write_answers(&clients[i]) || (clients[i].closing && clients[i].output_start==clients[i].output_end))
+          { close_client(&clients[i]); }
+        }
+     for(i=0; i<n_clients; i++)
+        {
+        if(clients[i].fd>=0) { continue; }
+        clients[i--] = clients[--n_clients];
+        }
+
+     if(n_polled>n_clients && n_clients<MAX_CLIENTS && (polled[n_polled-1].revents & POLLIN))
+       {
+       while(n_clients<MAX_CLIENTS && (fd = accept(listener, NULL, NULL))>=0)
+            {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            memset(&clients[n_clients], 0, sizeof(struct client));
+            clients[n_clients++].fd = fd;
+            }
+       }
+     } /* end of serving */
+
+for(i=0; i<n_clients; i++) { close_client(&clients[i]); }
+close(listener);
+unlink(path);
+free(clients);
+free(polled);
+free(buffer);
+if(log) { fprintf(log, " stopped serving parameters on %s\n", path); }
+return 0;
+} /* end of serve_parameters() */
+
+
+
+/*  *  *  * CLIENT *  *  *  */
+
+/* connects to a parameter service; returns the socket, or -1 */
+int connect_parameter_service(const char *path)
+{
+struct sockaddr_un address;
+int fd;
+
+if(strlen(path)>=sizeof(address.sun_path)) { return -1; }
+memset(&address, 0, sizeof(address));
+address.sun_family = AF_UNIX;
+strcpy(address.sun_path, path);
+if((fd = socket(AF_UNIX, SOCK_STREAM, 0))<0) { return -1; }
+if(connect(fd, (struct sockaddr *) &address, sizeof(address))) { close(fd); return -1; }
+return fd;
+} /* end of connect_parameter_service() */
+
+
+/* sends n queries, packed by pack_parameter_query(), and reads back the n_records records they
+   are answered with, reading while it writes so that a batch of any size cannot stall; returns 0,
+   or -1 if the connection fails */
+int query_parameter_service(int fd, const unsigned char *queries, int n, unsigned char *records, int n_records)
+{
+struct pollfd polled;
+size_t sent=0, received=0, to_send=(size_t) n*PARAMETER_QUERY_SIZE, to_receive=(size_t) n_records*PARAMETER_RECORD_SIZE;
+ssize_t k;
+
+while(received<to_receive)
+     {
+     if(sent<to_send && (k = send(fd, queries+sent, to_send-sent, MSG_DONTWAIT|MSG_NOSIGNAL))>0) { sent+=k; }
+     else if(sent<to_send && errno!=EAGAIN && errno!=EINTR) { return -1; }
+     if((k = recv(fd, records+received, to_receive-received, MSG_DONTWAIT))>0) { received+=k; continue; }
+     if(k==0 || (errno!=EAGAIN && errno!=EINTR)) { return -1; }
+     polled.fd = fd;
+     polled.events = sent<to_send ? POLLIN|POLLOUT : POLLIN;
+     poll(&polled, 1, -1);
+     }
+return 0;
+} /* end of query_parameter_service() */
+
+/******** END OF CODE FILE ********/
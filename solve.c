@@ -0,0 +1,42 @@
+/****
+ **** solve.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  The inverse of the parameter models: given a budget for the window size, which is what
+ ****  the cost of a SEG or fLPS run mostly depends on (SEG L, fLPS M), find the combinations of
+ ****  target length, focus and coverage whose parameters are valid and within it.
+ ****
+ ****  The search is simply over the whole grid, which with the built-in models is the tables
+ ****  generated at build time, so a full search is a few thousand lookups and answers at once.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include "parameters.h"
+
+/* the valid parameter sets for the focus, over every coverage and target length given, whose
+   window is at most max_window, from models or, if it is NULL, the built-in tables. Written to
+   feasible[], which must have room for n_coverages*n_lengths sets, in the order of the coverages
+   and then of the lengths; returns their number */
+int solve_parameters(const struct parameter_models *models, enum parameter_tool tool, enum calculation_type focus,
+                     int max_window, const int *coverages, int n_coverages, const int *lengths, int n_lengths,
+                     struct parameter_set *feasible)
+{
+struct parameter_set ps;
+int i, j, n=0;
+
+for(i=0; i<n_coverages; i++)
+   for(j=0; j<n_lengths; j++)
+      {
+      ps = models ? evaluate_model(models, tool, focus, lengths[j], coverages[i])
+                  : lookup_parameters(tool, focus, lengths[j], coverages[i]);
+      if(ps.not_valid || (tool==SEG ? ps.L : ps.big_m)>max_window) { continue; }
+      feasible[n++] = ps;
+      }
+return n;
+} /* end of solve_parameters() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,336 @@
+/****
+ **** summary.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Per-sequence summaries of a FASTA file, kept in an index file, so that rescanning the same
+ ****  proteome with new parameters need only read the sequences that can have regions.
+ ****
+ ****  Whether a sequence has any region at all depends on one number per window size: for SEG,
+ ****  the lowest complexity of its windows of length L (a region needs a window <= K1); for fLPS,
+ ****  the lowest log10 P-value of any residue in its windows of size w (a region needs one <= t
+ ****  for some w from m to M). The index holds these for every window size from
+ ****  SUMMARY_MIN_WINDOW to SUMMARY_MAX_WINDOW, rounded towards the biased side, with each
+ ****  sequence's offset and length. A set of parameters then picks out the sequences whose
+ ****  summaries reach its cutoffs, which are read directly (fasta_select()) and scanned as usual;
+ ****  the rest cannot have regions and are skipped, so the output is the same as a full scan's.
+ ****  Window sizes outside the index always mean a scan.
+ ****
+ ****  The fLPS summaries need no scan of every window: the largest count of a residue in any
+ ****  window of size w follows from the shortest span of each number of its occurrences, and
+ ****  the lowest P-value for w from the largest count of each residue.
+ ****
+ ****  The index file is mapped in place: a 64-byte header,
+ ****     0  char[8]  "PSUMMARY"
+ ****     8  uint32   version (SUMMARY_VERSION), byte order mark 0x01020304, tool, first and
+ ****                 last window sizes, row size
+ ****    32  uint64   number of sequences, size of the FASTA file, and its modification time
+ ****                 (seconds and nanoseconds)
+ ****  then one row per sequence: int64 offset of its '>', int32 length, and a uint16 per window
+ ****  size, padded to a multiple of 8 bytes. A SEG value is the complexity times 4096, rounded
+ ****  down; an fLPS value is -log10 P times 64, rounded up, with 0xfffe for anything beyond.
+ ****  0xffff means that there are no windows of that size to test. The FASTA file's size and
+ ****  time tell when the index no longer matches it.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "scan.h"
+
+#define SUMMARY_MAGIC "PSUMMARY"
+#define SUMMARY_BYTE_ORDER 0x01020304u
+#define NO_WINDOW 0xffff
+#define BEYOND 0xfffe              /* fLPS: -log10 P of at least (BEYOND-1)/64 */
+#define ROW_VALUES 12              /* the offset of the values in a row */
+
+static const double summary_scale[2] = {4096.0, 64.0};  /* [tool] */
+
+struct summary_header {
+  char magic[8];
+  uint32_t version, byte_order, tool, first_window, last_window, row_size;
+  uint64_t n_sequences, fasta_size;
+  int64_t fasta_seconds, fasta_nanoseconds;
+};
+
+struct summary_state {  /* one per thread */
+  struct seg_scanner **seg;     /* SEG, per window size */
+  unsigned char *codes;         /* of the current sequence */
+  int *positions, *spans;       /* fLPS */
+  unsigned char *row;
+};
+
+struct summary_context {
+  enum parameter_tool tool;
+  int n_windows;
+  size_t row_size;
+  struct flps_scanner *flps;    /* fLPS: just for its tables of log10 P */
+  struct summary_state *states;
+};
+
+
+/*  *  *  * BUILDING *  *  *  */
+
+/* the lowest complexity of the windows of size w, scaled and rounded */
+static int seg_summary(struct summary_state *state, int length, int w)
+{
+double lowest;
+int i;
+
+if(length<w) { return NO_WINDOW; }
+seg_complexity(state->seg[w-SUMMARY_MIN_WINDOW], state->codes, length);
+for(lowest=state->seg[w-SUMMARY_MIN_WINDOW]->complexity[0], i=1; i<=length-w; i++)
+   { if(state->seg[w-SUMMARY_MIN_WINDOW]->complexity[i]<lowest) { lowest = state->seg[w-SUMMARY_MIN_WINDOW]->complexity[i]; } }
+lowest = floor(lowest*summary_scale[SEG] - 1e-6);
+return lowest<0.0 ? 0 : lowest>=NO_WINDOW ? NO_WINDOW-1 : (int) lowest;
+} /* end of seg_summary() */
+
+
+/* the lowest log10 P at each window size, scaled and rounded, into values */
+static void flps_summary(const struct summary_context *sc, struct summary_state *state, int length, uint16_t *values,
+                         struct arena *arena)
+{
+const struct flps_scanner *flps=sc->flps;
+double *lowest, p;
+int r, i, n, j, w, count, stride=flps->stride, last;
+
+lowest = arena_alloc(arena, sc->n_windows*sizeof(double));
+for(w=0; w<sc->n_windows; w++) { lowest[w] = HUGE_VAL; }
+last = length<SUMMARY_MAX_WINDOW ? length : SUMMARY_MAX_WINDOW;
+
+for(r=0; r<NUMBER_OF_RESIDUES; r++)
+   {
+   for(i=n=0; i<length; i++) { if(state->codes[i]==r) { state->positions[n++] = i; } }
+   if(!n) { continue; }
+   /* spans[j]: the shortest stretch holding j+1 of the residue, for as many as a window can hold */
+   for(j=0; j<n && j<last; j++)
+      {
+      state->spans[j] = length+1;
+      for(i=0; i+j<n; i++)
+         { if(state->positions[i+j]-state->positions[i]+1<state->spans[j]) { state->spans[j] = state->positions[i+j]-state->positions[i]+1; } }
+      }
+   for(w=SUMMARY_MIN_WINDOW, count=0; w<=last; w++)
+      {
+      while(count<n && count<last && state->spans[count]<=w) { count++; }
+      if(!count) { continue; }
+      p = flps->log_tail[r][(w-flps->small_m)*stride+count];
+      if(p<lowest[w-SUMMARY_MIN_WINDOW]) { lowest[w-SUMMARY_MIN_WINDOW] = p; }
+      }
+   } /* end of for each residue */
+
+for(w=0; w<sc->n_windows; w++)
+   {
+   if(lowest[w]==HUGE_VAL) { values[w] = NO_WINDOW; continue; }
+   /* the scanner's table holds floats: allow for their rounding, to stay on the biased side */
+   p = ceil(-lowest[w]*(1.0+FLT_EPSILON)*summary_scale[FLPS] + 1e-6);
+   values[w] = p<0.0 ? 0 : p>=BEYOND ? BEYOND : (int) p;
+   }
+} /* end of flps_summary() */
+
+
+/* writes the row of one sequence to out */
+static void summarize_record(void *context, int thread, const struct fasta_record *record, struct arena *arena,
+                             FILE *out)
+{
+struct summary_context *sc=context;
+struct summary_state *state=&sc->states[thread];
+uint16_t *values;
+int64_t offset=record->offset;
+int32_t length=record->length;
+int w;
+
+state->codes = arena_alloc(arena, record->length);
+if(sc->tool==FLPS)
+  {
+  state->positions = arena_alloc(arena, record->length*sizeof(int));
+  state->spans = arena_alloc(arena, record->length*sizeof(int));
+  }
+encode_sequence(record->sequence, record->length, state->codes);
+
+memset(state->row, 0, sc->row_size);
+memcpy(state->row, &offset, 8);
+memcpy(state->row+8, &length, 4);
+values = (uint16_t *) (state->row+ROW_VALUES);
+if(sc->tool==SEG)
+  { for(w=SUMMARY_MIN_WINDOW; w<=SUMMARY_MAX_WINDOW; w++) { values[w-SUMMARY_MIN_WINDOW] = seg_summary(state, length, w); } }
+else { flps_summary(sc, state, length, values, arena); }
+fwrite(state->row, 1, sc->row_size, out);
+} /* end of summarize_record() */
+
+
+/* summarizes every sequence of the FASTA file (which must be a regular file) for the tool into
+   the index file filename, with n_threads threads; returns the number of sequences, or
+   SUMMARY_CANNOT_OPEN if either file cannot be opened */
+long build_summary_index(enum parameter_tool tool, const char *fasta, const char *filename, int n_threads)
+{
+struct summary_header header;
+struct summary_context sc;
+struct summary_state *state;
+struct flps_set set;
+struct stat st;
+FILE *out;
+long end;
+int t, w, result;
+
+if(stat(fasta, &st) || !S_ISREG(st.st_mode) || !(out = fopen(filename, "wb"))) { return SUMMARY_CANNOT_OPEN; }
+
+memset(&sc, 0, sizeof(sc));
+sc.tool = tool;
+sc.n_windows = SUMMARY_MAX_WINDOW-SUMMARY_MIN_WINDOW+1;
+sc.row_size = (ROW_VALUES + 2*sc.n_windows + 7)/8*8;
+if(tool==FLPS)
+  {
+  set.small_m = SUMMARY_MIN_WINDOW;
+  set.big_m = SUMMARY_MAX_WINDOW;
+  set.threshold = 0.0;
+  sc.flps = flps_create(1, &set, background_frequencies);
+  }
+sc.states = calloc(n_threads, sizeof(struct summary_state));
+for(t=0; t<n_threads; t++)
+   {
+   state = &sc.states[t];
+   state->row = malloc(sc.row_size);
+   if(tool!=SEG) { continue; }
+   state->seg = malloc(sc.n_windows*sizeof(struct seg_scanner *));
+   for(w=0; w<sc.n_windows; w++) { state->seg[w] = seg_create(SUMMARY_MIN_WINDOW+w, 0.0, 0.0); }
+   }
+
+memset(&header, 0, sizeof(header));
+memcpy(header.magic, SUMMARY_MAGIC, 8);
+header.version = SUMMARY_VERSION;
+header.byte_order = SUMMARY_BYTE_ORDER;
+header.tool = tool;
+header.first_window = SUMMARY_MIN_WINDOW;
+header.last_window = SUMMARY_MAX_WINDOW;
+header.row_size = sc.row_size;
+header.fasta_size = st.st_size;
+header.fasta_seconds = st.st_mtim.tv_sec;
+header.fasta_nanoseconds = st.st_mtim.tv_nsec;
+fwrite(&header, sizeof(header), 1, out);
+
+result = scan_fasta(fasta, n_threads, summarize_record, &sc, out);
+end = ftell(out);
+header.n_sequences = (end-(long) sizeof(header))/sc.row_size;
+fseek(out, 0, SEEK_SET);
+fwrite(&header, sizeof(header), 1, out);
+if(fclose(out) || result<0) { unlink(filename); result=-1; }
+
+for(t=0; t<n_threads; t++)
+   {
+   state = &sc.states[t];
+   for(w=0; tool==SEG && w<sc.n_windows; w++) { seg_free(state->seg[w]); }
+   free(state->seg);
+   free(state->row);
+   }
+free(sc.states);
+if(sc.flps) { flps_free(sc.flps); }
+return result<0 ? SUMMARY_CANNOT_OPEN : (long) header.n_sequences;
+} /* end of build_summary_index() */
+
+
+/*  *  *  * USING *  *  *  */
+
+/* maps the index file for the tool, checking that it was built from fasta as it is now; returns
+   NULL with *error set to one of the SUMMARY_ codes if it cannot be used */
+struct summary_index *open_summary_index(const char *filename, enum parameter_tool tool, const char *fasta, int *error)
+{
+struct summary_index *index;
+struct summary_header header;
+struct stat st, fasta_st;
+void *map;
+int fd;
+
+if((fd = open(filename, O_RDONLY))<0) { *error=SUMMARY_CANNOT_OPEN; return NULL; }
+if(fstat(fd, &st) || read(fd, &header, sizeof(header))!=sizeof(header) || memcmp(header.magic, SUMMARY_MAGIC, 8))
+  { close(fd); *error=SUMMARY_NOT_INDEX; return NULL; }
+if(header.version!=SUMMARY_VERSION || header.byte_order!=SUMMARY_BYTE_ORDER || header.tool!=(uint32_t) tool
+   || header.row_size<ROW_VALUES+2*(header.last_window-header.first_window+1)
+   || (uint64_t) st.st_size!=sizeof(header)+header.n_sequences*header.row_size)
+  { close(fd); *error=SUMMARY_INCOMPATIBLE; return NULL; }
+if(stat(fasta, &fasta_st) || (uint64_t) fasta_st.st_size!=header.fasta_size || fasta_st.st_mtim.tv_sec!=header.fasta_seconds
+   || fasta_st.st_mtim.tv_nsec!=header.fasta_nanoseconds)
+  { close(fd); *error=SUMMARY_STALE; return NULL; }
+map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+close(fd);
+if(map==MAP_FAILED) { *error=SUMMARY_CANNOT_OPEN; return NULL; }
+
+index = calloc(1, sizeof(struct summary_index));
+index->tool = tool;
+index->n_sequences = header.n_sequences;
+index->first_window = header.first_window;
+index->last_window = header.last_window;
+index->row_size = header.row_size;
+index->rows = (const unsigned char *) map + sizeof(header);
+index->map = map;
+index->map_size = st.st_size;
+return index;
+} /* end of open_summary_index() */
+
+
+/* whether the sequence with the row could have regions with the valid set ps */
+static int may_have_regions(const struct summary_index *index, const unsigned char *row, const struct parameter_set *ps)
+{
+const uint16_t *values=(const uint16_t *) (row+ROW_VALUES);
+int32_t length;
+int w, last;
+
+memcpy(&length, row+8, 4);
+if(index->tool==SEG)
+  {
+  if(ps->L>length) { return 0; }
+  if(ps->L<index->first_window || ps->L>index->last_window) { return 1; }
+  w = values[ps->L-index->first_window];
+  return w!=NO_WINDOW && w/summary_scale[SEG]<=ps->K1;
+  }
+last = ps->big_m<length ? ps->big_m : length;
+for(w=ps->small_m; w<=last; w++)
+   {
+   if(w<index->first_window || w>index->last_window) { return 1; }
+   if(values[w-index->first_window]==NO_WINDOW) { continue; }
+   if(values[w-index->first_window]==BEYOND || -values[w-index->first_window]/summary_scale[FLPS]<=ps->threshold) { return 1; }
+   }
+return 0;
+} /* end of may_have_regions() */
+
+
+/* the offsets of the sequences that could have regions with any of the n valid sets, in file
+   order, for scan_fasta_selected(); returns their number. offsets must have room for one per
+   sequence of the index */
+int select_sequences(const struct summary_index *index, const struct parameter_set *sets, int n_sets, long *offsets)
+{
+const unsigned char *row;
+int64_t offset;
+int i, s, n=0;
+
+for(i=0; i<index->n_sequences; i++)
+   {
+   row = index->rows + (size_t) i*index->row_size;
+   for(s=0; s<n_sets && !may_have_regions(index, row, &sets[s]); s++) { ; }
+   if(s==n_sets) { continue; }
+   memcpy(&offset, row, 8);
+   offsets[n++] = offset;
+   }
+return n;
+} /* end of select_sequences() */
+
+
+void close_summary_index(struct summary_index *index)
+{
+munmap(index->map, index->map_size);
+free(index);
+} /* end of close_summary_index() */
+
+/******** END OF CODE FILE ********/
@@ -0,0 +1,78 @@
+/****
+ **** tables.c
+ ****
+ ****/
+/****  Copyright 2023. Paul Martin Harrison. ****/
+/****
+ ****  Licensed under the 3-clause BSD license. See LICENSE.txt bundled with this program.
+ ****/
+/****
+ ****  Constant-time lookup of the parameter models from tables generated at build time
+ ****  (see maketables.c). Requests outside the tabulated range fall back to the formulas.
+ ****
+ ****/
+/*****************************************************************************************/
+
+#include <stdio.h>
+#include "parameters.h"
+
+#define TABLE_LENGTHS (MAX_TARGET_LENGTH-MIN_TARGET_LENGTH+1)
+
+struct parameter_row {
+  double K1, K2, threshold;
+  short L, small_m, big_m, lower_bound, upper_bound;
+  char not_valid, reason;
+};
+
+static const struct parameter_row parameter_table[2][2][NUMBER_OF_COVERAGES][TABLE_LENGTHS] = {
+#include "parameter_tables.inc"
+};
+
+
+struct parameter_set lookup_parameters(enum parameter_tool tool, enum calculation_type focus,
+                                       int target_length, int coverage)
+{
+struct parameter_set ps;
+const struct parameter_row *row;
+int i=coverage_index(coverage);
+
+if(i<0 || target_length<MIN_TARGET_LENGTH || target_length>MAX_TARGET_LENGTH)
+  { return calculate_parameters(tool, focus, target_length, coverage); }
+
+row = &parameter_table[tool][focus][i][target_length-MIN_TARGET_LENGTH];
+ps.tool=tool; ps.focus=focus;
+ps.target_length=target_length; ps.coverage=coverage;
+ps.K1=row->K1; ps.K2=row->K2; ps.threshold=row->threshold;
+ps.L=row->L; ps.small_m=row->small_m; ps.big_m=row->big_m;
+ps.lower_bound=row->lower_bound; ps.upper_bound=row->upper_bound;
+ps.not_valid=row->not_valid; ps.reason=row->reason;
+return ps;
+} /* end of lookup_parameters() */
+
+
+/* returns the number of table entries that differ from the formulas in parameters.c */
+int check_tables(void)
+{
+int tool, focus, i, target_length, errors=0;
+struct parameter_set a, b;
+
+for(tool=SEG; tool<=FLPS; tool++)
+   for(focus=DIVERSE; focus<=NARROW; focus++)
+      for(i=0; i<NUMBER_OF_COVERAGES; i++)
+         for(target_length=MIN_TARGET_LENGTH; target_length<=MAX_TARGET_LENGTH; target_length++)
+            {
+            a = calculate_parameters(tool, focus, target_length, coverage_levels[i]);
+            b = lookup_parameters(tool, focus, target_length, coverage_levels[i]);
+            if(a.K1!=b.K1 || a.K2!=b.K2 || a.threshold!=b.threshold || a.L!=b.L
+               || a.small_m!=b.small_m || a.big_m!=b.big_m || a.lower_bound!=b.lower_bound
+               || a.upper_bound!=b.upper_bound || a.not_valid!=b.not_valid || a.reason!=b.reason)
+              {
+              fprintf(stderr, "table mismatch: %s %s %d%% target length %d\n",
+                      tool_name[tool], focus_name[focus], coverage_levels[i], target_length);
+              errors++;
+              }
+            }
+return errors;
+} /* end of check_tables() */
+
+/******** END OF CODE FILE ********/